@@ -0,0 +1,53 @@
+﻿#include "SpatialGridEpoch.h"
+
+namespace SpatialGrid
+{
+	uint64 EpochDomain::Retire()
+	{
+		return Epoch.fetch_add(1);
+	}
+
+	uint64 EpochDomain::SafeEpoch() const
+	{
+		uint64 safe = Epoch.load();
+
+		for (const ReaderSlot& reader : Readers)
+		{
+			if (const uint64 pinned = reader.Epoch.load(); pinned != 0 && pinned < safe)
+			{
+				safe = pinned;
+			}
+		}
+
+		return safe;
+	}
+
+	int32 EpochDomain::Pin() const
+	{
+		// Start at a per thread slot so concurrent readers rarely contend for the same one.
+		const int32 first = static_cast<int32>(FPlatformTLS::GetCurrentThreadId() % MaxReaders);
+
+		for (;;)
+		{
+			for (int32 i = 0; i < MaxReaders; ++i)
+			{
+				const int32 reader = (first + i) % MaxReaders;
+				uint64 expected = 0;
+
+				// Pinning a stale epoch only delays reclamation, the reads after this store see anything published
+				// before a later Retire.
+				if (Readers[reader].Epoch.compare_exchange_strong(expected, Epoch.load()))
+				{
+					return reader;
+				}
+			}
+
+			FPlatformProcess::YieldThread();
+		}
+	}
+
+	void EpochDomain::Unpin(const int32 reader) const
+	{
+		Readers[reader].Epoch.store(0);
+	}
+}
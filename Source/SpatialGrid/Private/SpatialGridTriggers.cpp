@@ -0,0 +1,161 @@
+﻿#include "SpatialGridTriggers.h"
+
+namespace SpatialGrid
+{
+	TriggerId TriggerRegistry::Add(const Bounds& bounds, TArray<CellIndex>&& cells)
+	{
+		const TriggerId id = Volumes.Insert(bounds, MoveTemp(cells), ankerl::unordered_dense::set<ElementId>());
+
+		for (const CellIndex& cell : Volumes.Get(id)->Cells)
+		{
+			CellTriggers[cell].Add(id);
+		}
+
+		return id;
+	}
+
+	bool TriggerRegistry::Remove(const TriggerId id)
+	{
+		std::optional<Volume> volume = Volumes.Remove(id);
+		if (!volume)
+		{
+			return false;
+		}
+
+		for (const CellIndex& cell : volume->Cells)
+		{
+			if (auto it = CellTriggers.find(cell); it != CellTriggers.end())
+			{
+				it->second.RemoveSingleSwap(id);
+
+				if (it->second.IsEmpty())
+				{
+					CellTriggers.erase(it);
+				}
+			}
+		}
+
+		for (const ElementId& element : volume->Inside)
+		{
+			Events.Add(TriggerEvent{ .Trigger = id, .Element = element, .Type = ETriggerEvent::Exit });
+		}
+
+		return true;
+	}
+
+	const Bounds* TriggerRegistry::Get(const TriggerId id) const
+	{
+		const Volume* volume = Volumes.Get(id);
+		return volume ? &volume->Bounds : nullptr;
+	}
+
+	const TArray<CellIndex>* TriggerRegistry::GetCells(const TriggerId id) const
+	{
+		const Volume* volume = Volumes.Get(id);
+		return volume ? &volume->Cells : nullptr;
+	}
+
+	void TriggerRegistry::Reindex(TFunctionRef<TArray<CellIndex>(const Bounds&)> cells_of)
+	{
+		CellTriggers.clear();
+
+		for (auto& [id, volume] : Volumes)
+		{
+			volume.Cells = cells_of(volume.Bounds);
+
+			for (const CellIndex& cell : volume.Cells)
+			{
+				CellTriggers[cell].Add(id);
+			}
+		}
+	}
+
+	void TriggerRegistry::ShiftBy(const FVector& delta)
+	{
+		for (auto& [id, volume] : Volumes)
+		{
+			volume.Bounds.Origin += delta;
+		}
+	}
+
+	void TriggerRegistry::Evaluate(const TriggerId trigger, const ElementId id, const Bounds& bounds)
+	{
+		if (Volume* volume = Volumes.Get(trigger))
+		{
+			Test(trigger, *volume, id, bounds);
+		}
+	}
+
+	void TriggerRegistry::OnElementAdded(const ElementId id, const Bounds& bounds, const CellIndex& cell)
+	{
+		if (!IsEmpty())
+		{
+			TestCell(cell, id, bounds);
+		}
+	}
+
+	void TriggerRegistry::OnElementMoved(const ElementId id, const Bounds& bounds, const CellIndex& prev_cell, const CellIndex& cell)
+	{
+		if (IsEmpty())
+		{
+			return;
+		}
+
+		// Volumes of the previous cell the element no longer overlaps fail the test and emit their exit here,
+		// volumes shared by both cells are idempotent.
+		TestCell(cell, id, bounds);
+
+		if (prev_cell != cell)
+		{
+			TestCell(prev_cell, id, bounds);
+		}
+	}
+
+	void TriggerRegistry::OnElementRemoved(const ElementId id, const CellIndex& cell)
+	{
+		if (IsEmpty())
+		{
+			return;
+		}
+
+		if (const auto it = CellTriggers.find(cell); it != CellTriggers.end())
+		{
+			for (const TriggerId& trigger : it->second)
+			{
+				if (Volume* volume = Volumes.Get(trigger); volume && volume->Inside.erase(id) > 0)
+				{
+					Events.Add(TriggerEvent{ .Trigger = trigger, .Element = id, .Type = ETriggerEvent::Exit });
+				}
+			}
+		}
+	}
+
+	void TriggerRegistry::Test(const TriggerId trigger, Volume& volume, const ElementId id, const Bounds& bounds)
+	{
+		if (bounds.Overlaps(volume.Bounds))
+		{
+			if (volume.Inside.insert(id).second)
+			{
+				Events.Add(TriggerEvent{ .Trigger = trigger, .Element = id, .Type = ETriggerEvent::Enter });
+			}
+		}
+		else if (volume.Inside.erase(id) > 0)
+		{
+			Events.Add(TriggerEvent{ .Trigger = trigger, .Element = id, .Type = ETriggerEvent::Exit });
+		}
+	}
+
+	void TriggerRegistry::TestCell(const CellIndex& cell, const ElementId id, const Bounds& bounds)
+	{
+		if (const auto it = CellTriggers.find(cell); it != CellTriggers.end())
+		{
+			for (const TriggerId& trigger : it->second)
+			{
+				if (Volume* volume = Volumes.Get(trigger))
+				{
+					Test(trigger, *volume, id, bounds);
+				}
+			}
+		}
+	}
+}
@@ -10,6 +10,17 @@ namespace SpatialGrid
 		return FBox(Origin - BoxExtent, Origin + BoxExtent);
 	}
 
+	FBox Bounds::GetBoundingBox() const
+	{
+		switch (Type)
+		{
+			case BoundsType::Box: return GetBox();
+			case BoundsType::Sphere: return FBox(Origin - FVector(SphereRadius), Origin + FVector(SphereRadius));
+		}
+
+		return FBox(Origin, Origin);
+	}
+
 	double Bounds::GetRadius() const
 	{
 		switch (Type)
@@ -32,6 +43,17 @@ namespace SpatialGrid
 		return false;
 	}
 
+	bool Bounds::InsideSphere(const FVector& sphere_origin, const double sphere_radius) const
+	{
+		switch (Type)
+		{
+		case BoundsType::Box: return ((Origin - sphere_origin).GetAbs() + BoxExtent).SizeSquared() < FMath::Square(sphere_radius);
+		case BoundsType::Sphere: return SphereRadius < sphere_radius && FVector::DistSquared(sphere_origin, Origin) < FMath::Square(sphere_radius - SphereRadius);
+		}
+
+		return false;
+	}
+
 	bool Bounds::OverlapsBox(const FVector& box_origin, const FVector& box_extent) const
 	{
 		switch (Type)
@@ -43,6 +65,28 @@ namespace SpatialGrid
 		return false;
 	}
 
+	bool Bounds::Overlaps(const Bounds& other) const
+	{
+		switch (other.Type)
+		{
+		case BoundsType::Box: return OverlapsBox(other.Origin, other.BoxExtent);
+		case BoundsType::Sphere: return OverlapsSphere(other.Origin, other.SphereRadius);
+		}
+
+		return false;
+	}
+
+	bool Bounds::OverlapsCapsule(const FVector& start, const FVector& end, const double radius) const
+	{
+		switch (Type)
+		{
+		case BoundsType::Box: return SegmentBoxDistanceSquared(start, end, GetBox()) <= FMath::Square(radius);
+		case BoundsType::Sphere: return FMath::PointDistToSegmentSquared(Origin, start, end) <= FMath::Square(SphereRadius + radius);
+		}
+
+		return false;
+	}
+
 	bool Bounds::LineHitPoint(const FVector& start, const FVector& end, const FVector& dir, const FVector& inv_dir,
 	                          FVector& out_hit) const
 	{
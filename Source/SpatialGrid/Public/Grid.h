@@ -1,6 +1,10 @@
 ﻿#pragma once
 
+#include "Async/ParallelFor.h"
 #include "SlotMap.h"
+#include "SpatialGridAggregate.h"
+#include "SpatialGridElementList.h"
+#include "SpatialGridTriggers.h"
 #include "SpatialGridUtils.h"
 #include "unordered_dense.h"
 
@@ -11,8 +15,12 @@ namespace SpatialGrid
 	{
 		static_assert(Semantics::CellSize > 0, "cell size must be greater than zero");
 		static_assert(Semantics::MaxElementRadius < HalfCellSize<Semantics>(), "max element radius must be less than half cell size");
+		static_assert(GridDimensions<Semantics>() == 2 || GridDimensions<Semantics>() == 3, "grids are either 2D or 3D");
 
+		/// Payload stored inline with the element and handed to query callbacks, keep it to what queries read.
 		using ElementData = typename Semantics::ElementData;
+		/// Optional Semantics::ColdData, stored in rows indexed by ElementId::Index and only touched through GetColdData.
+		using ColdData = typename TColdData<Semantics>::Type;
 		
 		struct Element
 		{
@@ -28,11 +36,14 @@ namespace SpatialGrid
 			, Data(data) {}
 		
 			CellIndex Cell = CellIndex(TNumericLimits<int32>::Max());
+			/// Position of the element in its cell's element list.
+			int32 CellListIndex = INDEX_NONE;
 			Bounds Bounds;
 			ElementData Data;
 		};
 
-		using ElementIds = ankerl::unordered_dense::set<ElementId>;
+		/// Most occupied cells hold a handful of elements, those fit without any allocation.
+		using ElementIds = TElementIdList<4>;
 		
 		struct Cell
 		{
@@ -43,11 +54,44 @@ namespace SpatialGrid
 				return Bounds;
 			}
 			
+			/// Stores elements, or is overlapped by oversized elements stored in other cells.
 			bool HasElements() const
 			{
-				return !Elements.empty();
+				return !Elements.IsEmpty() || HasOversized();
 			}
 
+			/// Oversized elements overlap the cell, see Semantics::OversizedElements.
+			bool HasOversized() const
+			{
+				if constexpr (HasOversizedElements<Semantics>())
+				{
+					return !OversizedSlots.IsEmpty();
+				}
+				else
+				{
+					return false;
+				}
+			}
+
+			int32 NumElements() const
+			{
+				return Elements.Num();
+			}
+
+			/// Element at `index` in storage order, indices are invalidated by adding or removing elements of the cell.
+			ElementId GetElementAt(const int32 index) const
+			{
+				return Elements[index];
+			}
+
+			/// Running count, position sum and payload of the cell elements.
+			const TCellAggregate<Semantics>& GetAggregate() const requires (HasAggregates<Semantics>())
+			{
+				return Aggregate;
+			}
+
+			/// Every element stored in the cell, for scans by element origin. Scans by element bounds take the
+			/// overload with visits, which also sees oversized elements stored elsewhere.
 			template<typename F>
 			void ForEachElement(const TSpatialGrid& grid, F&& func) const
 			{
@@ -56,53 +100,241 @@ namespace SpatialGrid
 					grid.Elements.ApplyAt(id, std::forward<F>(func));
 				}
 			}
+
+			/// Candidates of scans by element bounds, the regular elements stored in the cell and the oversized
+			/// elements overlapping it that `visits` did not see yet.
+			template<typename F>
+			void ForEachElement(const TSpatialGrid& grid, TOversizedVisits<Semantics>& visits, F&& func) const
+			{
+				ForEachRegularElement(grid, func);
+				ForEachOversized(grid, visits, func);
+			}
+
+			/// Elements stored in the cell that are within MaxElementRadius.
+			template<typename F>
+			void ForEachRegularElement(const TSpatialGrid& grid, F&& func) const
+			{
+				if (!HasOversized())
+				{
+					ForEachElement(grid, func);
+					return;
+				}
+
+				// Oversized elements are stored in the cell holding their origin like any other element, bounds scans
+				// hand them out through the slots instead.
+				for (const ElementId& stored : Elements)
+				{
+					grid.Elements.ApplyAt(stored, [&func](const ElementId id, const Element& element)
+					{
+						if (!IsOversized(element.Bounds))
+						{
+							func(id, element);
+						}
+					});
+				}
+			}
+
+			/// Oversized elements overlapping the cell that `visits` did not see yet, marks them seen.
+			template<typename F>
+			void ForEachOversized(const TSpatialGrid& grid, TOversizedVisits<Semantics>& visits, F&& func) const
+			{
+				if constexpr (HasOversizedElements<Semantics>())
+				{
+					for (const int32 slot : OversizedSlots)
+					{
+						if (visits.Visit(slot))
+						{
+							grid.Elements.ApplyAt(grid.Oversized[slot].Id, func);
+						}
+					}
+				}
+			}
+
+			/// Cursor form of ForEachElement with visits for lazy views. Returns the next element and advances
+			/// `cursor`, which starts at 0, or ElementId() once the cell is exhausted.
+			ElementId NextElement(const TSpatialGrid& grid, TOversizedVisits<Semantics>& visits, int32& cursor) const
+			{
+				while (cursor < Elements.Num())
+				{
+					const ElementId id = Elements[cursor++];
+					if (!HasOversized() || !IsOversized(grid.Elements.Get(id)->Bounds))
+					{
+						return id;
+					}
+				}
+
+				if constexpr (HasOversizedElements<Semantics>())
+				{
+					while (cursor - Elements.Num() < OversizedSlots.Num())
+					{
+						const int32 slot = OversizedSlots[cursor++ - Elements.Num()];
+						if (visits.Visit(slot))
+						{
+							return grid.Oversized[slot].Id;
+						}
+					}
+				}
+
+				return ElementId();
+			}
 			
 		private:
 			ElementIds Elements;
 			FBox Bounds;
+			UE_NO_UNIQUE_ADDRESS TCellAggregate<Semantics> Aggregate;
+			/// Slots of the oversized elements overlapping the cell, into TSpatialGrid::Oversized.
+			UE_NO_UNIQUE_ADDRESS std::conditional_t<HasOversizedElements<Semantics>(), TArray<int32>, NoOversizedElements> OversizedSlots;
 			friend struct TSpatialGrid;
 		};
 
+		/// Element storage, with the epoch read paths only on grids using Semantics::EpochReads.
+		using ElementMap = TSlotMap<Element, UsesEpochReads<Semantics>()>;
+
+		/// Elements one thread adds without taking the grid lock, see AcquireInsertSlab.
+		using InsertSlab = typename ElementMap::Slab;
+
 	private:
 		using CellStorage = ankerl::unordered_dense::map<CellIndex, Cell>;
 
 	public:
-		TSpatialGrid() = default;
+		TSpatialGrid()
+		{
+			AttachEpochs();
+		}
 	
-		explicit TSpatialGrid(const FVector& InOrigin) : Origin(InOrigin) {}
+		explicit TSpatialGrid(const FVector& InOrigin) : Origin(InOrigin)
+		{
+			AttachEpochs();
+		}
+
+		/// Grid with its own cell size, see Semantics::RuntimeCellSize.
+		TSpatialGrid(const FVector& InOrigin, const double InCellSize) requires (HasRuntimeCellSize<Semantics>())
+		: Origin(InOrigin)
+		{
+			SetCellSize(InCellSize);
+			AttachEpochs();
+		}
 
-		double CellSize() const { return Semantics::CellSize; }
+		double CellSize() const { return GridCellSize.Get(); }
 
 		int32 NumCells() const { return Cells.size(); }
 	
 		CellIndex LocationToCoordinates(const FVector& world_location) const
 		{
-			return RoundVecToInt((world_location - Origin) / Semantics::CellSize);
+			return RoundVecToInt(LocationToCellSpace(world_location));
+		}
+
+		/// Continuous cell coordinates of a location, cell (0,0,0) spans [-0.5, 0.5] on every axis.
+		/// Planar grids drop the height, every location maps to layer 0.
+		FVector LocationToCellSpace(const FVector& world_location) const
+		{
+			FVector cell_space = (world_location - Origin) * GridCellSize.GetInverse() - FVector(CellOffset);
+			if constexpr (IsPlanar<Semantics>())
+			{
+				cell_space.Z = 0.;
+			}
+			return cell_space;
 		}
 	
+		/// Center of a cell, planar columns are centered at the origin height.
 		FVector CellCenter(const CellIndex& Coords) const
 		{
 			return FVector(
-				Origin.X + (Coords.X * Semantics::CellSize),
-				Origin.Y + (Coords.Y * Semantics::CellSize),
-				Origin.Z + (Coords.Z * Semantics::CellSize));
+				Origin.X + ((Coords.X + CellOffset.X) * CellSize()),
+				Origin.Y + ((Coords.Y + CellOffset.Y) * CellSize()),
+				Origin.Z + ((Coords.Z + CellOffset.Z) * CellSize()));
 		}
 		
+		/// Elements larger than MaxElementRadius need Semantics::OversizedElements, they are stored in the cell holding
+		/// their origin and additionally registered in every cell their bounds overlap.
+		/// Not allowed between ReserveConcurrentInserts and MergeInsertSlabs.
 		ElementId AddElement(const Bounds& bounds, ElementData&& data)
 		{
-			checkf(bounds.GetRadius() < HalfCellSize<Semantics>(), TEXT("element radius must be less than cell extent"));
+			checkf(HasOversizedElements<Semantics>() || bounds.GetRadius() < CellSize() * 0.5, TEXT("element radius must be less than cell extent"));
 			
 			const CellIndex coords = LocationToCoordinates(bounds.Origin);
 
 			FScopeLock Lock(&CriticalSection);
 			
 			ElementId new_id = Elements.Insert(coords, bounds, std::move(data));
+			AddColdRows(new_id.Index + 1);
+			Element& element = *Elements.Get(new_id);
 			Cell& cell = FindOrAddCell(coords);
-			cell.Elements.insert(new_id);
+			AddToCell(cell, new_id, element);
+			cell.Aggregate.Add(bounds.Origin, element.Data);
+			RecordChange(new_id, EElementChange::Added, coords, coords);
+			Triggers.OnElementAdded(new_id, bounds, coords);
+
+			if (IsOversized(bounds))
+			{
+				AddOversized(new_id, bounds, coords);
+			}
 			
 			return new_id;
 		}
 
+		/// Adds an element together with its cold payload.
+		ElementId AddElement(const Bounds& bounds, ElementData&& data, ColdData&& cold) requires (HasColdData<Semantics>())
+		{
+			FScopeLock Lock(&CriticalSection);
+
+			const ElementId new_id = AddElement(bounds, std::move(data));
+			Cold[new_id.Index] = std::move(cold);
+			return new_id;
+		}
+
+		/// Reserves ids for `max_elements` concurrent insertions spread over at most `max_slabs` slabs.
+		/// Slab threads write slots and cold rows without the lock, so until MergeInsertSlabs elements can only be
+		/// added through slabs, the locked AddElement could reallocate that storage under them. Removals stay
+		/// allowed, epoch grids hold back compacting their storage until the merge.
+		void ReserveConcurrentInserts(const uint32 max_elements, const int32 max_slabs = 64)
+		{
+			FScopeLock Lock(&CriticalSection);
+			Elements.ReserveSlabs(max_elements, max_slabs);
+			AddColdRows(Elements.NumSlots());
+		}
+
+		/// Thread safe and lock free. Claims a block of `capacity` reserved ids for the calling thread,
+		/// nullptr once the reservation ran out.
+		InsertSlab* AcquireInsertSlab(const uint32 capacity)
+		{
+			return Elements.AcquireSlab(capacity);
+		}
+
+		/// Lock free, only the thread that acquired `slab` may add to it. GetElement resolves the id right away,
+		/// the element becomes visible to cells, queries, triggers and the change feed on MergeInsertSlabs.
+		ElementId AddElement(InsertSlab& slab, const Bounds& bounds, ElementData&& data)
+		{
+			checkf(bounds.GetRadius() < CellSize() * 0.5, TEXT("element radius must be less than cell extent"));
+			checkf(!IsOversized(bounds), TEXT("oversized elements can't be added through insert slabs"));
+			return Elements.InsertIntoSlab(slab, LocationToCoordinates(bounds.Origin), bounds, std::move(data));
+		}
+
+		/// Lock free like the slab AddElement above, cold rows of reserved ids exist already.
+		ElementId AddElement(InsertSlab& slab, const Bounds& bounds, ElementData&& data, ColdData&& cold) requires (HasColdData<Semantics>())
+		{
+			const ElementId new_id = AddElement(slab, bounds, std::move(data));
+			Cold[new_id.Index] = std::move(cold);
+			return new_id;
+		}
+
+		/// Publishes every element added through slabs, call once all inserting threads are done.
+		void MergeInsertSlabs()
+		{
+			FScopeLock Lock(&CriticalSection);
+
+			Elements.MergeSlabs([this](const ElementId id, Element& element)
+			{
+				// Recomputed under the lock instead of trusting the coordinates the slab thread computed.
+				element.Cell = LocationToCoordinates(element.Bounds.Origin);
+				Cell& cell = FindOrAddCell(element.Cell);
+				AddToCell(cell, id, element);
+				cell.Aggregate.Add(element.Bounds.Origin, element.Data);
+				RecordChange(id, EElementChange::Added, element.Cell, element.Cell);
+				Triggers.OnElementAdded(id, element.Bounds, element.Cell);
+			});
+		}
+
 		void RemoveElement(const ElementId id)
 		{
 			FScopeLock Lock(&CriticalSection);
@@ -111,7 +343,21 @@ namespace SpatialGrid
 			{
 				if (auto it = Cells.find(element->Cell); it != Cells.end())
 				{
-					it->second.Elements.erase(id);
+					RemoveFromCell(it->second, *element);
+					it->second.Aggregate.Remove(element->Bounds.Origin, element->Data);
+				}
+				
+				RecordChange(id, EElementChange::Removed, element->Cell, element->Cell);
+				Triggers.OnElementRemoved(id, element->Cell);
+
+				if (IsOversized(element->Bounds))
+				{
+					RemoveOversized(id);
+				}
+
+				if constexpr (HasColdData<Semantics>())
+				{
+					Cold[id.Index] = ColdData();
 				}
 			}
 		}
@@ -122,6 +368,70 @@ namespace SpatialGrid
 			return Elements.Get(id);
 		}
 		
+		/// Pins the current epoch for GetElement(id, guard), hold guards only briefly since they delay freeing
+		/// storage of removed elements.
+		EpochDomain::ReadGuard PinEpoch() const requires (UsesEpochReads<Semantics>())
+		{
+			return EpochDomain::ReadGuard(*Epochs);
+		}
+
+		/// Thread safe and lock free. The element stays readable until `guard` is released even if other threads
+		/// remove it or grow the storage meanwhile, fields UpdateElementLocation writes in place may be read torn.
+		const Element* GetElement(const ElementId& id, const EpochDomain::ReadGuard& guard) const requires (UsesEpochReads<Semantics>())
+		{
+			return Elements.Get(id, guard);
+		}
+
+		/// Frees element storage no epoch reader can see anymore. Mutations do this as they go,
+		/// call it when the grid stops changing while readers come and go.
+		void ReclaimRetired() requires (UsesEpochReads<Semantics>())
+		{
+			FScopeLock Lock(&CriticalSection);
+			Elements.Reclaim();
+		}
+		
+		/** This function is not thread safe!!! */
+		/// Cold payload of an element, resolved straight from the id so query callbacks can fetch it only for the
+		/// elements they keep without pulling it through every scan.
+		const ColdData* GetColdData(const ElementId& id) const requires (HasColdData<Semantics>())
+		{
+			return Elements.Contains(id) ? &Cold[id.Index] : nullptr;
+		}
+
+		/** This function is not thread safe!!! */
+		ColdData* GetColdData(const ElementId& id) requires (HasColdData<Semantics>())
+		{
+			return Elements.Contains(id) ? &Cold[id.Index] : nullptr;
+		}
+
+		/** This function is not thread safe!!! */
+		/// Mutable payload of an element, bounds only change through UpdateElementLocation. Grids with aggregates
+		/// edit payloads through ModifyElementData so the cell totals follow.
+		ElementData* GetElementData(const ElementId& id) requires (!HasAggregates<Semantics>())
+		{
+			Element* element = Elements.Get(id);
+			return element ? &element->Data : nullptr;
+		}
+
+		/// Edits the payload of an element in place, `func` receives an `ElementData&`. The old payload is taken
+		/// out of the cell aggregate before the edit and the new one added after it. Returns false for unknown or
+		/// staged ids.
+		template<typename F>
+		bool ModifyElementData(const ElementId& id, F&& func)
+		{
+			FScopeLock Lock(&CriticalSection);
+
+			if (Elements.GetDenseIndex(id) == INDEX_NONE) { return false; }
+
+			Element* element = Elements.Get(id);
+			auto cell_it = Cells.find(element->Cell); check(cell_it != Cells.end());
+
+			cell_it->second.Aggregate.Remove(element->Bounds.Origin, element->Data);
+			func(element->Data);
+			cell_it->second.Aggregate.Add(element->Bounds.Origin, element->Data);
+			return true;
+		}
+		
 		void ClearEmptyCells()
 		{
 			FScopeLock Lock(&CriticalSection);
@@ -135,25 +445,42 @@ namespace SpatialGrid
 
 		void UpdateElementLocation(const ElementId id, const FVector& new_location)
 		{
-			Element* element = Elements.Get(id); if (!element) { return; }
-
 			FScopeLock Lock(&CriticalSection);
 
+			// Staged slab elements have no cell to move out of before MergeInsertSlabs, they are ignored like removals.
+			if (Elements.GetDenseIndex(id) == INDEX_NONE) { return; }
+
+			Element* element = Elements.Get(id);
+
+			const FVector prev_location = element->Bounds.Origin;
 			element->Bounds.Origin = new_location;
 			
 			const CellIndex new_coords = LocationToCoordinates(new_location);
+			RecordChange(id, EElementChange::Moved, element->Cell, new_coords);
+			Triggers.OnElementMoved(id, element->Bounds, element->Cell, new_coords);
 
 			if (new_coords != element->Cell)
 			{
 				auto cell_it = Cells.find(element->Cell); check(cell_it != Cells.end());
 				
 				Cell& prev_cell = cell_it->second;
-				prev_cell.Elements.erase(id);
+				RemoveFromCell(prev_cell, *element);
+				prev_cell.Aggregate.Remove(prev_location, element->Data);
 				
 				Cell& new_cell = FindOrAddCell(new_coords);
-				new_cell.Elements.insert(id);
+				AddToCell(new_cell, id, *element);
+				new_cell.Aggregate.Add(new_location, element->Data);
 				element->Cell = new_coords;
 			}
+			else if constexpr (HasAggregates<Semantics>())
+			{
+				Cells.find(new_coords)->second.Aggregate.Move(prev_location, new_location);
+			}
+
+			if (IsOversized(element->Bounds))
+			{
+				MoveOversized(id, element->Bounds, new_coords);
+			}
 		}
 		
 		/// This function is not thread safe!!!
@@ -163,6 +490,15 @@ namespace SpatialGrid
 			return it != Cells.end() ? &(it->second) : nullptr;
 		}
 
+		/// This function is not thread safe!!!
+		/// Cell at `index` in storage order, indices run up to NumCells() and are invalidated by adding or clearing cells.
+		const Cell& GetCellAt(const int32 index, CellIndex& out_coords) const
+		{
+			const auto& [coords, cell] = Cells.values()[index];
+			out_coords = coords;
+			return cell;
+		}
+
 		/// This function is not thread safe!!!
 		template<typename  F>
 		void GetCell(const CellIndex& Coords, F&& func) const
@@ -185,9 +521,237 @@ namespace SpatialGrid
 		template <typename IterFunc>
 		void ForEachElement(IterFunc&& Func) const
 		{
-			for (const auto& [id, element] : Elements)
+			for (const auto& entry : Elements)
+			{
+				if (ElementMap::IsLive(entry))
+				{
+					Func(entry.first, entry.second);
+				}
+			}
+		}
+
+		/// Changes the cell size and re-buckets every element. Cell coordinates are recomputed in parallel over the
+		/// storage pages, cells are then relinked in storage order. Element ids and pointers stay valid, cached
+		/// queries built for the old cell size fall back to range scans and change feed consumers resync.
+		/// Insert slabs have to be merged first, slab threads read the cell size without the lock.
+		void Rebuild(const double new_cell_size) requires (HasRuntimeCellSize<Semantics>())
+		{
+			FScopeLock Lock(&CriticalSection);
+			checkf(!Elements.HasSlabs(), TEXT("merge insert slabs before rebuilding the grid"));
+
+			SetCellSize(new_cell_size);
+			RebuildCells([](Element&) {});
+		}
+
+		/**
+		 * Follows a world origin shift that moved every location by `delta`, element and trigger bounds are moved
+		 * along while the cell lattice stays anchored at the grid origin. When `delta` is a whole number of cells
+		 * the lattice lines up with the old one, cells keep their coordinates through a stored cell offset and
+		 * elements and cells are shifted in place in parallel without touching cell membership. Any other delta
+		 * re-buckets every element like Rebuild. Element ids and pointers stay valid either way, change feed
+		 * consumers resync since they may hold locations from before the shift. Insert slabs have to be merged first,
+		 * their staged elements are not in the storage the shift walks.
+		 */
+		void RebaseOrigin(const FVector& delta)
+		{
+			FScopeLock Lock(&CriticalSection);
+			checkf(!Elements.HasSlabs(), TEXT("merge insert slabs before rebasing the grid origin"));
+
+			CellIndex shift = RoundVecToInt(delta * GridCellSize.GetInverse());
+			if constexpr (IsPlanar<Semantics>())
+			{
+				// Heights never select a cell, only the planar part has to line up.
+				shift.Z = 0;
+			}
+
+			const FVector cell_delta = FVector(shift) * CellSize();
+			const bool whole_cells = IsPlanar<Semantics>()
+				? cell_delta.X == delta.X && cell_delta.Y == delta.Y
+				: cell_delta == delta;
+
+			Triggers.ShiftBy(delta);
+
+			if (!whole_cells)
+			{
+				RebuildCells([&delta](Element& element) { element.Bounds.Origin += delta; });
+				return;
+			}
+
+			CellOffset += shift;
+
+			ParallelFor(TEXT("SpatialGrid.RebaseOrigin"), Elements.NumPages(), 1, [this, &delta](const int32 page)
+			{
+				for (auto& [id, element] : Elements.GetPage(page))
+				{
+					element.Bounds.Origin += delta;
+				}
+			});
+
+			constexpr int32 chunk_size = ParallelChunkSize<typename CellStorage::value_type>();
+			const auto cells = Cells.begin();
+			const int32 num_cells = Cells.size();
+
+			ParallelFor(TEXT("SpatialGrid.RebaseOrigin"), FMath::DivideAndRoundUp(num_cells, chunk_size), 1, [&](const int32 chunk)
+			{
+				for (int32 i = chunk * chunk_size, end = FMath::Min(i + chunk_size, num_cells); i < end; ++i)
+				{
+					// Cells keep their coordinates, their world placement moves with their contents.
+					Cell& cell = cells[i].second;
+					cell.Bounds = cell.Bounds.ShiftBy(cell_delta);
+					cell.Aggregate.ShiftBy(delta);
+				}
+			});
+
+			Bounds = Bounds.ShiftBy(cell_delta);
+
+			ResyncChangeFeed();
+		}
+
+		/// Reorders element storage so elements of a cell, and of cells close in Morton order, are contiguous again
+		/// after churn scattered them, which keeps query scans on few cache lines. A pass is spread over calls, each
+		/// moving at most `max_moves` elements, returns true once a pass completed. Element ids stay valid,
+		/// pointers from GetElement don't. Insert slabs have to be merged first, merging appends to the storage
+		/// a pass reorders.
+		bool Defragment(const int32 max_moves) requires (!UsesEpochReads<Semantics>())
+		{
+			FScopeLock Lock(&CriticalSection);
+			checkf(!Elements.HasSlabs(), TEXT("merge insert slabs before defragmenting the grid"));
+
+			if (Defrag.Order.IsEmpty())
 			{
-				Func(id, element);
+				Defrag = DefragState();
+				ForEachCell([this](const CellIndex& coords, const Cell& cell)
+				{
+					if (cell.HasElements())
+					{
+						Defrag.Order.Add(coords);
+					}
+				});
+				Defrag.Order.Sort([](const CellIndex& a, const CellIndex& b) { return MortonCode(a) < MortonCode(b); });
+			}
+
+			int32 moves = 0;
+
+			while (Defrag.NextCell < Defrag.Order.Num() && Defrag.Target < Elements.Num())
+			{
+				const Cell* cell = GetCell(Defrag.Order[Defrag.NextCell]);
+
+				if (!cell || Defrag.NextElement >= cell->NumElements())
+				{
+					Defrag.NextCell += 1;
+					Defrag.NextElement = 0;
+					continue;
+				}
+
+				const int32 index = Elements.GetDenseIndex(cell->GetElementAt(Defrag.NextElement));
+
+				// Elements moved into the ordered prefix by changes since the last call stay where they are.
+				if (index > Defrag.Target)
+				{
+					if (moves == max_moves)
+					{
+						return false;
+					}
+
+					Elements.SwapDense(index, Defrag.Target);
+					moves += 1;
+				}
+
+				if (index >= Defrag.Target)
+				{
+					Defrag.Target += 1;
+				}
+				Defrag.NextElement += 1;
+			}
+
+			Defrag.Order.Reset();
+			return true;
+		}
+
+		/// Runs func() while holding the grid lock, so queries inside it can run on any thread.
+		/// Adding, moving and removing elements from other threads waits until func returns.
+		template<typename F>
+		decltype(auto) Locked(F&& func) const
+		{
+			FScopeLock Lock(&CriticalSection);
+			return func();
+		}
+
+		/// This function is not thread safe!!!
+		/// Runs func(coords, cell) for every cell on the task graph, func must not modify the grid.
+		template <typename IterFunc>
+		void ParallelForEachCell(IterFunc&& func) const
+		{
+			constexpr int32 chunk_size = ParallelChunkSize<typename CellStorage::value_type>();
+			const auto& cells = Cells.values();
+			const int32 num_cells = cells.size();
+
+			ParallelFor(TEXT("SpatialGrid.ForEachCell"), FMath::DivideAndRoundUp(num_cells, chunk_size), 1, [&](const int32 chunk)
+			{
+				for (int32 i = chunk * chunk_size, end = FMath::Min(i + chunk_size, num_cells); i < end; ++i)
+				{
+					func(cells[i].first, cells[i].second);
+				}
+			});
+		}
+
+		/**
+		 * This function is not thread safe!!!
+		 * Runs func(context, coords, cell) for every cell on the task graph with one default constructed Context
+		 * per worker, then calls reduce(context) for every context on the calling thread.
+		 */
+		template <typename Context, typename IterFunc, typename ReduceFunc>
+		void ParallelForEachCellWithContext(IterFunc&& func, ReduceFunc&& reduce) const
+		{
+			constexpr int32 chunk_size = ParallelChunkSize<typename CellStorage::value_type>();
+			const auto& cells = Cells.values();
+			const int32 num_cells = cells.size();
+
+			TArray<Context> contexts;
+			ParallelForWithTaskContext(TEXT("SpatialGrid.ForEachCell"), contexts, FMath::DivideAndRoundUp(num_cells, chunk_size), 1,
+				[&](Context& context, const int32 chunk)
+			{
+				for (int32 i = chunk * chunk_size, end = FMath::Min(i + chunk_size, num_cells); i < end; ++i)
+				{
+					func(context, cells[i].first, cells[i].second);
+				}
+			});
+
+			for (Context& context : contexts)
+			{
+				reduce(context);
+			}
+		}
+
+		/// This function is not thread safe!!!
+		/// Runs func(id, element) for every element on the task graph, func must not modify the grid.
+		template <typename IterFunc>
+		void ParallelForEachElement(IterFunc&& func) const
+		{
+			ParallelFor(TEXT("SpatialGrid.ForEachElement"), NumElementChunks(), 1, [&](const int32 chunk)
+			{
+				ForEachElementInChunk(chunk, func);
+			});
+		}
+
+		/// This function is not thread safe!!!
+		/// Element version of ParallelForEachCellWithContext, func(context, id, element).
+		template <typename Context, typename IterFunc, typename ReduceFunc>
+		void ParallelForEachElementWithContext(IterFunc&& func, ReduceFunc&& reduce) const
+		{
+			TArray<Context> contexts;
+			ParallelForWithTaskContext(TEXT("SpatialGrid.ForEachElement"), contexts, NumElementChunks(), 1,
+				[&](Context& context, const int32 chunk)
+			{
+				ForEachElementInChunk(chunk, [&](const ElementId id, const Element& element)
+				{
+					func(context, id, element);
+				});
+			});
+
+			for (Context& context : contexts)
+			{
+				reduce(context);
 			}
 		}
 
@@ -206,22 +770,422 @@ namespace SpatialGrid
 			return Bounds;
 		}
 
+		/// Registers a standing volume, elements already overlapping it emit enter events right away.
+		TriggerId AddTrigger(const Bounds& bounds)
+		{
+			FScopeLock Lock(&CriticalSection);
+
+			const TriggerId trigger = Triggers.Add(bounds, TriggerCells(bounds));
+			TOversizedVisits<Semantics> visits;
+
+			for (const CellIndex& coords : *Triggers.GetCells(trigger))
+			{
+				GetCell(coords, [&](const Cell& cell)
+				{
+					cell.ForEachElement(*this, visits, [&](const ElementId id, const Element& element)
+					{
+						Triggers.Evaluate(trigger, id, element.Bounds);
+					});
+				});
+			}
+
+			return trigger;
+		}
+
+		/// Unregisters a volume, elements still inside emit exit events.
+		bool RemoveTrigger(const TriggerId id)
+		{
+			FScopeLock Lock(&CriticalSection);
+			return Triggers.Remove(id);
+		}
+
+		const TriggerRegistry& GetTriggers() const
+		{
+			return Triggers;
+		}
+
+		/// Hands every enter/exit event buffered since the last call to `func` and clears the buffer.
+		template<typename F>
+		void ConsumeTriggerEvents(F&& func)
+		{
+			FScopeLock Lock(&CriticalSection);
+
+			for (const TriggerEvent& event : Triggers.GetEvents())
+			{
+				func(event);
+			}
+
+			Triggers.ResetEvents();
+		}
+
+		/// Sequence number the next recorded change will get.
+		uint64 ChangeSequence() const
+		{
+			return ChangesBase + Changes.Num();
+		}
+
+		/// False when changes after `sequence` were already trimmed and a consumer has to resync from scratch.
+		bool CanReplayChangesSince(const uint64 sequence) const
+		{
+			return sequence >= ChangesBase && sequence <= ChangeSequence();
+		}
+
+		/// This function is not thread safe!!!
+		/// Visits every change recorded at or after `sequence` in order and returns the sequence to continue from.
+		template<typename F>
+		uint64 ForEachChangeSince(const uint64 sequence, F&& func) const
+		{
+			static_assert(TracksChanges<Semantics>(), "change feed requires Semantics::TrackChanges");
+			check(CanReplayChangesSince(sequence));
+
+			for (int32 i = static_cast<int32>(sequence - ChangesBase); i < Changes.Num(); ++i)
+			{
+				func(Changes[i]);
+			}
+
+			return ChangeSequence();
+		}
+
+		/// Drops changes before `sequence`, call once every consumer has caught up to it, e.g. the smallest
+		/// GetChangeCursor of the tracked queries and neighbour lists reading the grid. Feeds nobody trims are
+		/// capped at ChangeFeedCapacity.
+		void TrimChanges(const uint64 sequence)
+		{
+			FScopeLock Lock(&CriticalSection);
+
+			const int32 count = static_cast<int32>(FMath::Min(sequence, ChangeSequence()) - FMath::Min(sequence, ChangesBase));
+			if (count > 0)
+			{
+				Changes.RemoveAt(0, count, EAllowShrinking::No);
+				ChangesBase += count;
+			}
+		}
+
 	private:
 		FVector Origin = FVector::ZeroVector;
-		TSlotMap<Element> Elements;
+		UE_NO_UNIQUE_ADDRESS TCellSize<Semantics> GridCellSize;
+		/// Whole cells the world moved by since construction, see RebaseOrigin.
+		CellIndex CellOffset = CellIndex::ZeroValue;
+		ElementMap Elements;
 		CellStorage Cells;
 		FBox Bounds;
-		FCriticalSection CriticalSection;
+		mutable FCriticalSection CriticalSection;
+		TArray<ElementChange> Changes;
+		uint64 ChangesBase = 0;
+		TriggerRegistry Triggers;
+		TUniquePtr<EpochDomain> Epochs;
+
+		/// Progress of the current Defragment pass.
+		struct DefragState
+		{
+			TArray<CellIndex> Order;
+			int32 NextCell = 0;
+			int32 NextElement = 0;
+			int32 Target = 0;
+		};
+		DefragState Defrag;
+		UE_NO_UNIQUE_ADDRESS std::conditional_t<HasColdData<Semantics>(), TPagedArray<ColdData, DefaultPageSize<ColdData>()>, NoColdData> Cold;
+
+		/// Oversized element of a slot and the range of cells searched when it was registered.
+		struct OversizedEntry
+		{
+			ElementId Id;
+			CellIndex Min;
+			CellIndex Max;
+		};
+
+		/// Oversized elements by slot, slots are kept dense so query visits stay small.
+		UE_NO_UNIQUE_ADDRESS std::conditional_t<HasOversizedElements<Semantics>(), TArray<OversizedEntry>, NoOversizedElements> Oversized;
+
+		/// Cold rows are never moved or freed, removal resets them so reused ids start from a default payload.
+		void AddColdRows(const uint32 count)
+		{
+			if constexpr (HasColdData<Semantics>())
+			{
+				while (Cold.size() < count)
+				{
+					Cold.emplace_back();
+				}
+			}
+		}
+
+		/// Parallel loops split every page of the element storage into chunks, so no chunk straddles two pages.
+		static constexpr int32 ElementChunkSize = ParallelChunkSize<typename ElementMap::Entry>();
+		static constexpr int32 ChunksPerPage = FMath::DivideAndRoundUp<int32>(ElementMap::PageSize, ElementChunkSize);
+
+		int32 NumElementChunks() const
+		{
+			return Elements.NumPages() * ChunksPerPage;
+		}
+
+		template<typename F>
+		void ForEachElementInChunk(const int32 chunk, F&& func) const
+		{
+			const auto page = Elements.GetPage(chunk / ChunksPerPage);
+			const int32 first = (chunk % ChunksPerPage) * ElementChunkSize;
+			const int32 last = FMath::Min(first + ElementChunkSize, page.Num());
+
+			for (int32 i = first; i < last; ++i)
+			{
+				if (ElementMap::IsLive(page[i]))
+				{
+					func(page[i].first, page[i].second);
+				}
+			}
+		}
+
+		/// Runs update(element) and recomputes the element cell in parallel over the storage pages, then relinks
+		/// cells in storage order and moves trigger volumes to the cells of the new layout.
+		template<typename F>
+		void RebuildCells(F&& update)
+		{
+			ParallelFor(TEXT("SpatialGrid.Rebuild"), Elements.NumPages(), 1, [this, &update](const int32 page)
+			{
+				for (auto& [id, element] : Elements.GetPage(page))
+				{
+					update(element);
+					element.Cell = LocationToCoordinates(element.Bounds.Origin);
+				}
+			});
+
+			Cells.clear();
+			Bounds = FBox(ForceInit);
+
+			for (auto& entry : Elements)
+			{
+				if (ElementMap::IsLive(entry))
+				{
+					Element& element = entry.second;
+					Cell& cell = FindOrAddCell(element.Cell);
+					AddToCell(cell, entry.first, element);
+					cell.Aggregate.Add(element.Bounds.Origin, element.Data);
+				}
+			}
+
+			if constexpr (HasOversizedElements<Semantics>())
+			{
+				for (int32 slot = 0; slot < Oversized.Num(); ++slot)
+				{
+					const Element& element = *Elements.Get(Oversized[slot].Id);
+					RegisterOversized(slot, element.Bounds, element.Cell);
+				}
+			}
+
+			Triggers.Reindex([this](const SpatialGrid::Bounds& bounds) { return TriggerCells(bounds); });
+			Defrag = DefragState();
+			ResyncChangeFeed();
+		}
+
+		/// Recorded changes refer to an old layout or old locations, consumers replaying from before start over.
+		void ResyncChangeFeed()
+		{
+			if constexpr (TracksChanges<Semantics>())
+			{
+				ChangesBase = ChangeSequence() + 1;
+				Changes.Reset();
+			}
+		}
+
+		void SetCellSize(const double cell_size) requires (HasRuntimeCellSize<Semantics>())
+		{
+			checkf(Semantics::MaxElementRadius < cell_size * 0.5, TEXT("max element radius must be less than half cell size"));
+			GridCellSize.Set(cell_size);
+		}
+
+		/// Every cell an element overlapping `bounds` can be stored in, elements stick out of their cell by up to
+		/// MaxElementRadius.
+		TArray<CellIndex> TriggerCells(const SpatialGrid::Bounds& bounds) const
+		{
+			const FBox box = bounds.GetBoundingBox().ExpandBy(Semantics::MaxElementRadius);
+			const CellIndex min = LocationToCoordinates(box.Min);
+			const CellIndex max = LocationToCoordinates(box.Max);
+
+			TArray<CellIndex> cells;
+			cells.Reserve((max.X - min.X + 1) * (max.Y - min.Y + 1) * (max.Z - min.Z + 1));
+
+			for (int32 z = min.Z; z <= max.Z; ++z)
+			{
+				for (int32 y = min.Y; y <= max.Y; ++y)
+				{
+					for (int32 x = min.X; x <= max.X; ++x)
+					{
+						cells.Add(CellIndex(x, y, z));
+					}
+				}
+			}
+
+			return cells;
+		}
+
+		void AttachEpochs()
+		{
+			if constexpr (UsesEpochReads<Semantics>())
+			{
+				Epochs = MakeUnique<EpochDomain>();
+				Elements.AttachEpochs(*Epochs);
+			}
+		}
+
+		void RecordChange(const ElementId id, const EElementChange type, const CellIndex& prev_cell, const CellIndex& cell)
+		{
+			if constexpr (TracksChanges<Semantics>())
+			{
+				if (Changes.Num() >= ChangeFeedCapacity<Semantics>())
+				{
+					// Dropping half at once keeps the shift amortized, consumers behind the new base resync.
+					const int32 dropped = Changes.Num() / 2;
+					Changes.RemoveAt(0, dropped, EAllowShrinking::No);
+					ChangesBase += dropped;
+				}
+
+				Changes.Add(ElementChange{ .Id = id, .Type = type, .PrevCell = prev_cell, .Cell = cell });
+			}
+		}
 		
+		void AddToCell(Cell& cell, const ElementId id, Element& element)
+		{
+			element.CellListIndex = cell.Elements.Add(id);
+		}
+
+		/// Swap-removes the element from its cell list and patches the back index of the id moved into its place.
+		void RemoveFromCell(Cell& cell, const Element& element)
+		{
+			if (const ElementId moved = cell.Elements.RemoveAtSwap(element.CellListIndex); moved != ElementId())
+			{
+				Elements.Get(moved)->CellListIndex = element.CellListIndex;
+			}
+		}
+
+		static bool IsOversized(const SpatialGrid::Bounds& bounds)
+		{
+			return HasOversizedElements<Semantics>() && bounds.GetRadius() > Semantics::MaxElementRadius;
+		}
+
+		template<typename F>
+		static void ForEachCellIn(const CellIndex& min, const CellIndex& max, F&& func)
+		{
+			for (int32 z = min.Z; z <= max.Z; ++z)
+			{
+				for (int32 y = min.Y; y <= max.Y; ++y)
+				{
+					for (int32 x = min.X; x <= max.X; ++x)
+					{
+						func(CellIndex(x, y, z));
+					}
+				}
+			}
+		}
+
+		/// Lists `slot` in every cell the bounds overlap. Cells only the bounding box reaches stay out, so every
+		/// element listed in a cell completely inside a query shape overlaps the shape.
+		void RegisterOversized(const int32 slot, const SpatialGrid::Bounds& bounds, const CellIndex& home) requires (HasOversizedElements<Semantics>())
+		{
+			const FBox box = bounds.GetBoundingBox();
+			const FVector cell_extent = SpatialGrid::CellExtent<Semantics>(CellSize());
+			OversizedEntry& entry = Oversized[slot];
+			entry.Min = LocationToCoordinates(box.Min);
+			entry.Max = LocationToCoordinates(box.Max);
+
+			ForEachCellIn(entry.Min, entry.Max, [&](const CellIndex& coords)
+			{
+				if (coords == home || bounds.OverlapsBox(CellCenter(coords), cell_extent))
+				{
+					FindOrAddCell(coords).OversizedSlots.Add(slot);
+				}
+			});
+		}
+
+		void UnregisterOversized(const int32 slot) requires (HasOversizedElements<Semantics>())
+		{
+			ForEachCellIn(Oversized[slot].Min, Oversized[slot].Max, [&](const CellIndex& coords)
+			{
+				if (const auto it = Cells.find(coords); it != Cells.end())
+				{
+					it->second.OversizedSlots.RemoveSingleSwap(slot);
+				}
+			});
+		}
+
+		int32 FindOversized(const ElementId id) const requires (HasOversizedElements<Semantics>())
+		{
+			return Oversized.IndexOfByPredicate([id](const OversizedEntry& entry) { return entry.Id == id; });
+		}
+
+		void AddOversized(const ElementId id, const SpatialGrid::Bounds& bounds, const CellIndex& home)
+		{
+			if constexpr (HasOversizedElements<Semantics>())
+			{
+				const int32 slot = Oversized.Add(OversizedEntry{ .Id = id });
+				RegisterOversized(slot, bounds, home);
+
+				// Volumes are indexed by the cells elements can be stored in, an oversized element reaches the
+				// volumes of every cell it overlaps. Tests are idempotent, volumes listed in several cells are fine.
+				ForEachCellIn(Oversized[slot].Min, Oversized[slot].Max, [&](const CellIndex& coords)
+				{
+					Triggers.OnElementAdded(id, bounds, coords);
+				});
+			}
+		}
+
+		void MoveOversized(const ElementId id, const SpatialGrid::Bounds& bounds, const CellIndex& home)
+		{
+			if constexpr (HasOversizedElements<Semantics>())
+			{
+				const int32 slot = FindOversized(id); check(slot != INDEX_NONE);
+				const OversizedEntry prev = Oversized[slot];
+
+				UnregisterOversized(slot);
+				RegisterOversized(slot, bounds, home);
+
+				// Volumes of the old cells the element left emit their exit, like OnElementMoved does for one cell.
+				auto test_cell = [&](const CellIndex& coords) { Triggers.OnElementMoved(id, bounds, coords, coords); };
+				ForEachCellIn(prev.Min, prev.Max, test_cell);
+				ForEachCellIn(Oversized[slot].Min, Oversized[slot].Max, test_cell);
+			}
+		}
+
+		/// Frees the slot of a removed element, the last slot moves into the hole to keep slots dense.
+		void RemoveOversized(const ElementId id)
+		{
+			if constexpr (HasOversizedElements<Semantics>())
+			{
+				const int32 slot = FindOversized(id); check(slot != INDEX_NONE);
+
+				ForEachCellIn(Oversized[slot].Min, Oversized[slot].Max, [&](const CellIndex& coords)
+				{
+					Triggers.OnElementRemoved(id, coords);
+				});
+				UnregisterOversized(slot);
+
+				const int32 last = Oversized.Num() - 1;
+				if (slot != last)
+				{
+					ForEachCellIn(Oversized[last].Min, Oversized[last].Max, [&](const CellIndex& coords)
+					{
+						if (const auto it = Cells.find(coords); it != Cells.end())
+						{
+							if (const int32 index = it->second.OversizedSlots.Find(last); index != INDEX_NONE)
+							{
+								it->second.OversizedSlots[index] = slot;
+							}
+						}
+					});
+					Oversized[slot] = Oversized[last];
+				}
+				Oversized.Pop();
+			}
+		}
+
 		Cell& FindOrAddCell(const CellIndex& coords)
 		{
 			auto[it, is_new_cell] = Cells.try_emplace(coords);
 			
 			if (is_new_cell)
 			{
-				constexpr FVector cell_extent = SpatialGrid::CellExtent<Semantics>();
+				const FVector cell_extent = SpatialGrid::CellExtent<Semantics>(CellSize());
 				const FVector cell_origin = CellCenter(coords);
-				Bounds += FBox(cell_origin - cell_extent, cell_origin + cell_extent);
+				it->second.Bounds = FBox(cell_origin - cell_extent, cell_origin + cell_extent);
+				Bounds += it->second.Bounds;
 			}
 			
 			return it->second;
@@ -0,0 +1,201 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include <bit>
+#include <iterator>
+#include <vector>
+
+namespace SpatialGrid
+{
+	/**
+	 * Array stored in fixed size pages listed by a page table. Growing allocates new pages and never moves
+	 * existing elements, so addresses stay stable until the element itself is removed.
+	 * Elements are contiguous within a page, see GetPage for page wise iteration.
+	 */
+	template<typename T, uint32 PageSize>
+	struct TPagedArray
+	{
+		static_assert(FMath::IsPowerOfTwo(PageSize), "page size must be a power of two");
+
+		template<bool Const>
+		struct TIterator
+		{
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type		= T;
+			using difference_type	= std::ptrdiff_t;
+			using pointer			= std::conditional_t<Const, const T*, T*>;
+			using reference			= std::conditional_t<Const, const T&, T&>;
+
+			TIterator() = default;
+			TIterator(T* const* pages, const size_t index) : Pages(pages), Index(index) {}
+			operator TIterator<true>() const { return TIterator<true>(Pages, Index); }
+
+			reference operator*() const { return Pages[Index / PageSize][Index % PageSize]; }
+			pointer operator->() const { return &**this; }
+			reference operator[](const difference_type offset) const { return *(*this + offset); }
+
+			TIterator& operator++() { ++Index; return *this; }
+			TIterator operator++(int) { TIterator it = *this; ++Index; return it; }
+			TIterator& operator--() { --Index; return *this; }
+			TIterator operator--(int) { TIterator it = *this; --Index; return it; }
+			TIterator& operator+=(const difference_type offset) { Index += offset; return *this; }
+			TIterator& operator-=(const difference_type offset) { Index -= offset; return *this; }
+			TIterator operator+(const difference_type offset) const { return TIterator(Pages, Index + offset); }
+			TIterator operator-(const difference_type offset) const { return TIterator(Pages, Index - offset); }
+			friend TIterator operator+(const difference_type offset, const TIterator& it) { return it + offset; }
+			difference_type operator-(const TIterator& other) const { return difference_type(Index) - difference_type(other.Index); }
+
+			bool operator==(const TIterator& other) const { return Index == other.Index; }
+			auto operator<=>(const TIterator& other) const { return Index <=> other.Index; }
+
+		private:
+			T* const* Pages = nullptr;
+			size_t Index = 0;
+		};
+
+		using iterator = TIterator<false>;
+		using const_iterator = TIterator<true>;
+
+		TPagedArray() = default;
+
+		TPagedArray(TPagedArray&& other) noexcept
+		: PageTable(std::move(other.PageTable))
+		, Count(other.Count)
+		{
+			other.PageTable.clear();
+			other.Count = 0;
+		}
+
+		TPagedArray& operator=(TPagedArray&& other)
+		{
+			if (this != &other)
+			{
+				Reset();
+				PageTable = std::move(other.PageTable);
+				Count = other.Count;
+				other.PageTable.clear();
+				other.Count = 0;
+			}
+			return *this;
+		}
+
+		TPagedArray(const TPagedArray&) = delete;
+		TPagedArray& operator=(const TPagedArray&) = delete;
+
+		~TPagedArray()
+		{
+			Reset();
+		}
+
+		size_t size() const { return Count; }
+		bool empty() const { return Count == 0; }
+		size_t capacity() const { return PageTable.size() * PageSize; }
+
+		T& operator[](const size_t index) { return PageTable[index / PageSize][index % PageSize]; }
+		const T& operator[](const size_t index) const { return PageTable[index / PageSize][index % PageSize]; }
+
+		T& back() { return (*this)[Count - 1]; }
+		const T& back() const { return (*this)[Count - 1]; }
+
+		template<typename ...Args>
+		T& emplace_back(Args&&... args)
+		{
+			if (Count == capacity())
+			{
+				PageTable.push_back(static_cast<T*>(FMemory::Malloc(sizeof(T) * PageSize, alignof(T))));
+			}
+
+			T* item = new (&(*this)[Count]) T(std::forward<Args>(args)...);
+			Count += 1;
+			return *item;
+		}
+
+		void push_back(const T& item) { emplace_back(item); }
+		void push_back(T&& item) { emplace_back(std::move(item)); }
+
+		/// Destroys the last element, its page stays allocated for the next one.
+		void pop_back()
+		{
+			Count -= 1;
+			(*this)[Count].~T();
+		}
+
+		/// Allocates pages for `count` elements up front.
+		void reserve(const size_t count)
+		{
+			GrowPageTable(count);
+			while (capacity() < count)
+			{
+				PageTable.push_back(static_cast<T*>(FMemory::Malloc(sizeof(T) * PageSize, alignof(T))));
+			}
+		}
+
+		/// Makes room in the page table for the pages of `count` elements. Returns the replaced table so its buffer
+		/// can outlive readers still indexing it, empty if the table had room already.
+		std::vector<T*> GrowPageTable(const size_t count)
+		{
+			const size_t num_pages = (count + PageSize - 1) / PageSize;
+			if (num_pages <= PageTable.capacity())
+			{
+				return {};
+			}
+
+			std::vector<T*> table;
+			table.reserve(std::max<size_t>({ PageTable.capacity() * 2, num_pages, 16 }));
+			table.insert(table.end(), PageTable.begin(), PageTable.end());
+			std::swap(table, PageTable);
+			return table;
+		}
+
+		/// Page table, pages past the last element may be missing.
+		T* const* GetPageTable() const { return PageTable.data(); }
+
+		int32 NumPages() const { return static_cast<int32>((Count + PageSize - 1) / PageSize); }
+
+		/// Contiguous elements of page `page`, only the last page is partially filled.
+		TArrayView<T> GetPage(const int32 page)
+		{
+			return TArrayView<T>(PageTable[page], PageNum(page));
+		}
+
+		TArrayView<const T> GetPage(const int32 page) const
+		{
+			return TArrayView<const T>(PageTable[page], PageNum(page));
+		}
+
+		iterator begin() { return iterator(PageTable.data(), 0); }
+		iterator end() { return iterator(PageTable.data(), Count); }
+		const_iterator begin() const { return const_iterator(const_cast<T* const*>(PageTable.data()), 0); }
+		const_iterator end() const { return const_iterator(const_cast<T* const*>(PageTable.data()), Count); }
+
+	private:
+		std::vector<T*> PageTable;
+		size_t Count = 0;
+
+		int32 PageNum(const int32 page) const
+		{
+			return static_cast<int32>(std::min<size_t>(PageSize, Count - size_t(page) * PageSize));
+		}
+
+		void Reset()
+		{
+			while (Count > 0)
+			{
+				pop_back();
+			}
+
+			for (T* page : PageTable)
+			{
+				FMemory::Free(page);
+			}
+			PageTable.clear();
+		}
+	};
+
+	/// Elements per page of roughly 64KB, at least 64.
+	template<typename T>
+	static consteval uint32 DefaultPageSize()
+	{
+		return std::max<uint32>(64, std::bit_floor<uint32>(65536 / sizeof(T)));
+	}
+}
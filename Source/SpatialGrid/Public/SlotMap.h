@@ -1,11 +1,14 @@
 ﻿#pragma once
+#include "PagedArray.h"
 #include "SpatialGrid.h"
+#include "SpatialGridEpoch.h"
 #include "SpatialGridTypes.h"
 #include "Logging/StructuredLog.h"
 
 namespace SpatialGrid
 {
-	struct Slot
+	/// Written through std::atomic_ref, readers of an epoch view load it while the owner reuses it.
+	struct alignas(8) Slot
 	{
 		/// Even = vacant, odd = occupied.
 		uint32_t Version;
@@ -14,10 +17,34 @@ namespace SpatialGrid
 
 		bool IsOccupied() const { return (Version % 2) != 0; }
 	};
+
+	/// Set in Slot::IdxOrFree of elements still in a staging slab, the remaining bits hold the slab index.
+	inline static constexpr uint32_t STAGED_SLOT = 0x80000000u;
+	inline static constexpr uint32_t NO_FREE_SLOT = UINT32_MAX;
 	
-	template <typename V>
+	/// `EpochReads` compiles in the tombstone and copy-on-grow paths AttachEpochs needs, which copy values. Maps
+	/// without it keep removals moving values out, so move-only values work.
+	template <typename V, bool EpochReads = false>
 	struct TSlotMap
 	{
+		using Entry = std::pair<ElementId, V>;
+		static constexpr uint32 PageSize = DefaultPageSize<Entry>();
+		using DenseArray = TPagedArray<Entry, PageSize>;
+
+		/// Block of claimed slots a single thread fills without locks, see AcquireSlab.
+		struct Slab
+		{
+			int32 Num() const { return static_cast<int32>(Entries.size()); }
+			bool IsFull() const { return Entries.size() >= Capacity; }
+
+		private:
+			uint32_t Index = 0;
+			uint32_t First = 0;
+			uint32_t Capacity = 0;
+			std::vector<Entry> Entries;
+			friend struct TSlotMap;
+		};
+
 		TSlotMap() {}
 		
 		explicit TSlotMap(size_t Capacity)
@@ -25,37 +52,42 @@ namespace SpatialGrid
 			Dense.reserve(Capacity);
 		}
 
+		/// Not allowed while slabs are reserved, slab owners write into the slot vector without locks and a new
+		/// slot could reallocate it under them. Merge the slabs first, see MergeSlabs.
 		template<typename ...Args>
 		ElementId Insert(Args&&... args)
 		{
+			checkf(Slabs.empty(), TEXT("merge the reserved slabs before inserting outside of them"));
+
 			if (Dense.size() >= UINT32_MAX)
 			{
 				UE_LOGFMT(LogSpatialGrid, Fatal, "SparseSet number of elements overflow");
 				return ElementId();
 			}
 
-			size_t index = FreeHead;
-			uint32_t version;
+			const size_t index = FreeHead != NO_FREE_SLOT ? FreeHead : Slots.size();
+			const uint32_t version = FreeHead != NO_FREE_SLOT ? (Slots[index].Version | 1) : 1;
+			const ElementId id = ElementId(index, version);
 
-			if (index < Dense.size())
-			{
-				Slot& slot = Slots[index];
-				version = slot.Version | 1;
-				FreeHead = slot.IdxOrFree;
+			ReserveDense(1);
+			Dense.push_back(std::make_pair(id, V(std::forward<Args>(args)...)));
+			SyncView();
 
-				slot.Version = version;
-				slot.IdxOrFree = Dense.size();
+			const Slot slot = Slot{ .Version = version, .IdxOrFree = static_cast<uint32_t>(Dense.size() - 1) };
+
+			if (FreeHead != NO_FREE_SLOT)
+			{
+				FreeHead = Slots[index].IdxOrFree;
+				StoreSlot(index, slot);
 			}
 			else
 			{
-				version = 1;
-				Slots.push_back(Slot{.Version = 1, .IdxOrFree = static_cast<uint32_t>(Dense.size())});
-				FreeHead = Slots.size();
+				ReserveSlots(1);
+				Slots.push_back(slot);
+				SyncView();
 			}
-			
-			ElementId id = ElementId(index, version);
-			Dense.push_back(std::make_pair(id, V(std::forward<Args>(args)...)));
 
+			Reclaim();
 			return id;
 		}
 		
@@ -66,9 +98,9 @@ namespace SpatialGrid
 				return std::nullopt;
 			}
 
-			Slot& slot = Slots[id.Index];
+			const Slot slot = Slots[id.Index];
 			
-			if (!slot.IsOccupied() || slot.Version != id.Version)
+			if (!slot.IsOccupied() || slot.Version != id.Version || (slot.IdxOrFree & STAGED_SLOT))
 			{
 				return std::nullopt;
 			}
@@ -78,12 +110,26 @@ namespace SpatialGrid
 			check(dense_idx < Dense.size());
 			check(Dense[dense_idx].first == id);
 
-			V value = std::move(Dense[dense_idx].second);
-
 			// Free slot.
-			slot.Version += 1;
-			slot.IdxOrFree = FreeHead;
+			StoreSlot(id.Index, Slot{ .Version = slot.Version + 1, .IdxOrFree = static_cast<uint32_t>(FreeHead) });
 			FreeHead = id.Index;
+
+			if constexpr (EpochReads)
+			{
+				if (Epochs)
+				{
+					// Epoch readers may still hold the entry, leave a tombstone and compact into fresh storage later.
+					V value = Dense[dense_idx].second;
+					Dense[dense_idx].first = ElementId();
+					NumTombstones += 1;
+
+					CompactIfSparse();
+					Reclaim();
+					return value;
+				}
+			}
+
+			V value = std::move(Dense[dense_idx].second);
 			
 			if (dense_idx != (Dense.size() - 1))
 			{
@@ -95,6 +141,17 @@ namespace SpatialGrid
 			return value;
 		}
 
+		int32 Num() const { return static_cast<int32>(Dense.size() - NumTombstones); }
+
+		/// True between ReserveSlabs and MergeSlabs.
+		bool HasSlabs() const { return !Slabs.empty(); }
+
+		/// Slots handed out so far, every id index is below it.
+		uint32_t NumSlots() const { return static_cast<uint32_t>(Slots.size()); }
+
+		/// False for dense entries removed while an EpochDomain is attached, iteration has to skip them.
+		static bool IsLive(const Entry& entry) { return entry.first.Version != 0; }
+
 		bool Contains(const ElementId& Id) const {
 			if (Id.Index >= Slots.size())
 			{
@@ -115,7 +172,7 @@ namespace SpatialGrid
 			const Slot& slot = Slots[id.Index];
 			
 			return (slot.IsOccupied() && slot.Version == id.Version)
-				? &Dense[slot.IdxOrFree].second
+				? &Resolve(id, slot)
 				: nullptr;
 		}
 
@@ -129,49 +186,382 @@ namespace SpatialGrid
 			Slot& slot = Slots[id.Index];
 			
 			return (slot.IsOccupied() && slot.Version == id.Version)
-				? &Dense[slot.IdxOrFree].second
+				? &Resolve(id, slot)
 				: nullptr;
 		}
 
 		template<typename F>
 		void ApplyAt(const ElementId& id, F&& func) const
 		{
-			if (id.Index < Slots.size()) [[unlikely]]
+			if (id.Index >= Slots.size()) [[unlikely]]
 			{
 				return;
 			}
 
 			if (const Slot& slot = Slots[id.Index]; slot.IsOccupied() && slot.Version == id.Version) [[likely]]
 			{
-				check(slot.IdxOrFree < Dense.size());
-				const auto&[id_, value] = Dense[slot.IdxOrFree];
-				func(id_, value);
+				func(id, Resolve(id, slot));
+			}
+		}
+
+		/// Not thread safe. From now on removals keep tombstones and growth copies into new storage, so entries
+		/// found through Get(id, guard) stay readable until the guard is released.
+		void AttachEpochs(EpochDomain& epochs) requires (EpochReads)
+		{
+			static_assert(std::is_copy_constructible_v<V>, "epoch reads copy entries instead of moving them");
+			check(!Epochs);
+
+			Epochs = &epochs;
+			Republish({}, {}, {});
+		}
+
+		/// Position of a live id in the dense array, INDEX_NONE for stale or staged ids.
+		int32 GetDenseIndex(const ElementId& id) const
+		{
+			if (id.Index >= Slots.size()) [[unlikely]]
+			{
+				return INDEX_NONE;
+			}
+
+			const Slot& slot = Slots[id.Index];
+			return slot.IsOccupied() && slot.Version == id.Version && !(slot.IdxOrFree & STAGED_SLOT)
+				? static_cast<int32>(slot.IdxOrFree)
+				: INDEX_NONE;
+		}
+
+		/// Not thread safe. Exchanges two dense entries and patches their slots, ids stay valid while pointers
+		/// to either entry now see the other one. Not available to epoch readers, whose pointers must not change.
+		void SwapDense(const size_t a, const size_t b)
+		{
+			check(!Epochs);
+			std::swap(Dense[a], Dense[b]);
+			StoreSlot(Dense[a].first.Index, Slot{ .Version = Dense[a].first.Version, .IdxOrFree = static_cast<uint32_t>(a) });
+			StoreSlot(Dense[b].first.Index, Slot{ .Version = Dense[b].first.Version, .IdxOrFree = static_cast<uint32_t>(b) });
+		}
+
+		/// Dense entries are stored in pages of PageSize that never move as the map grows, loops can split work by page.
+		int32 NumPages() const { return Dense.NumPages(); }
+
+		/// Contiguous dense entries of page `page`, may contain tombstones, see IsLive.
+		TArrayView<const Entry> GetPage(const int32 page) const { return Dense.GetPage(page); }
+
+		/// Values may be changed in place, ids must be left alone.
+		TArrayView<Entry> GetPage(const int32 page) { return Dense.GetPage(page); }
+
+		/// Thread safe and lock free for holders of a guard of the attached EpochDomain.
+		/// Entries inserted by another thread show up once their Insert returned, staged ones only after MergeSlabs.
+		const V* Get(const ElementId& id, const EpochDomain::ReadGuard&) const
+		{
+			check(Epochs);
+			const View* view = Published.load();
+
+			for (;;)
+			{
+				if (id.Index >= view->NumSlots.load(std::memory_order_acquire)) [[unlikely]]
+				{
+					return nullptr;
+				}
+
+				const Slot slot = std::atomic_ref<Slot>(const_cast<Slot&>(view->Slots[id.Index])).load(std::memory_order_acquire);
+
+				if (!slot.IsOccupied() || slot.Version != id.Version || (slot.IdxOrFree & STAGED_SLOT))
+				{
+					return nullptr;
+				}
+
+				if (slot.IdxOrFree < view->NumDense.load(std::memory_order_acquire)) [[likely]]
+				{
+					return &view->Pages[slot.IdxOrFree / PageSize][slot.IdxOrFree % PageSize].second;
+				}
+
+				// Appended to storage that replaced this view after it was loaded.
+				const View* current = Published.load();
+				if (current == view)
+				{
+					return nullptr;
+				}
+				view = current;
+			}
+		}
+
+		/// Not thread safe. Frees storage retired before the oldest epoch still pinned, mutations call it as well.
+		void Reclaim()
+		{
+			if (!Retired.empty())
+			{
+				const uint64 safe = Epochs->SafeEpoch();
+				std::erase_if(Retired, [safe](const RetiredStorage& retired) { return retired.Epoch < safe; });
+			}
+		}
+
+		/// Not thread safe. Adds `count` fresh slots and `max_slabs` slabs that AcquireSlab can hand out without
+		/// reallocating anything, slots nobody claimed go back to the free list on MergeSlabs.
+		void ReserveSlabs(const uint32_t count, const int32 max_slabs)
+		{
+			checkf(Slabs.empty(), TEXT("merge the previous slabs before reserving new ones"));
+			check(max_slabs > 0);
+
+			const size_t first = Slots.size();
+			ReserveSlots(count);
+			Slots.resize(first + count, Slot{ .Version = 0, .IdxOrFree = NO_FREE_SLOT });
+			SyncView();
+			ClaimHead.store(static_cast<uint32_t>(first));
+			ClaimEnd = static_cast<uint32_t>(first + count);
+			Slabs.resize(max_slabs);
+		}
+
+		/// Thread safe and lock free. Claims a range of `capacity` reserved slots for the calling thread,
+		/// nullptr once the slabs or slots reserved by ReserveSlabs ran out.
+		Slab* AcquireSlab(const uint32_t capacity)
+		{
+			const uint32_t slab_index = SlabsUsed.fetch_add(1);
+			if (slab_index >= Slabs.size())
+			{
+				return nullptr;
+			}
+
+			const uint32_t first = ClaimHead.fetch_add(capacity);
+			Slab& slab = Slabs[slab_index];
+			slab.Index = slab_index;
+			slab.First = first;
+			// An exhausted claim keeps an empty slab so MergeSlabs still sees every acquired index.
+			slab.Capacity = first < ClaimEnd ? FMath::Min(capacity, ClaimEnd - first) : 0;
+			slab.Entries.reserve(slab.Capacity);
+
+			return slab.Capacity > 0 ? &slab : nullptr;
+		}
+
+		/// Lock free, only the thread owning `slab` may insert into it. The id resolves through Get right away,
+		/// other threads should only use it after MergeSlabs or some other synchronization.
+		template<typename ...Args>
+		ElementId InsertIntoSlab(Slab& slab, Args&&... args)
+		{
+			check(!slab.IsFull());
+
+			const uint32_t index = slab.First + static_cast<uint32_t>(slab.Entries.size());
+			const ElementId id = ElementId(index, 1);
+			slab.Entries.emplace_back(id, V(std::forward<Args>(args)...));
+			StoreSlot(index, Slot{ .Version = 1, .IdxOrFree = STAGED_SLOT | slab.Index });
+
+			return id;
+		}
+
+		/// Not thread safe. Moves every slab entry into the dense array, calling func(id, value) for each,
+		/// and frees the reserved slots nobody used. Pointers into slabs are invalid afterwards.
+		template<typename F>
+		void MergeSlabs(F&& func)
+		{
+			const uint32_t used = FMath::Min<uint32_t>(SlabsUsed.load(), Slabs.size());
+			const uint32_t claimed_end = FMath::Min(ClaimHead.load(), ClaimEnd);
+
+			size_t staged = 0;
+			for (uint32_t slab_index = 0; slab_index < used; ++slab_index)
+			{
+				staged += Slabs[slab_index].Entries.size();
 			}
+			ReserveDense(staged);
+
+			for (uint32_t slab_index = 0; slab_index < used; ++slab_index)
+			{
+				Slab& slab = Slabs[slab_index];
+
+				for (auto& [id, value] : slab.Entries)
+				{
+					Dense.emplace_back(id, std::move(value));
+					SyncView();
+					StoreSlot(id.Index, Slot{ .Version = id.Version, .IdxOrFree = static_cast<uint32_t>(Dense.size() - 1) });
+					func(id, Dense.back().second);
+				}
+
+				for (uint32_t index = slab.First + slab.Num(); index < slab.First + slab.Capacity; ++index)
+				{
+					Release(index);
+				}
+
+				slab = Slab();
+			}
+
+			for (uint32_t index = claimed_end; index < ClaimEnd; ++index)
+			{
+				Release(index);
+			}
+
+			Slabs.clear();
+			SlabsUsed.store(0);
+			ClaimHead.store(0);
+			ClaimEnd = 0;
+
+			if constexpr (EpochReads)
+			{
+				// Removals during the reservation only left tombstones behind.
+				if (Epochs)
+				{
+					CompactIfSparse();
+				}
+			}
+			Reclaim();
 		}
 		
 	private:
-		std::vector<std::pair<ElementId, V>> Dense = {};
+		/// Storage epoch readers resolve ids through. Counts grow in place, the buffers are replaced as a whole.
+		struct View
+		{
+			Entry* const* Pages = nullptr;
+			const Slot* Slots = nullptr;
+			std::atomic<uint32_t> NumDense = 0;
+			std::atomic<uint32_t> NumSlots = 0;
+		};
+
+		/// Replaced storage kept alive until no reader pins the epoch it was retired in.
+		struct RetiredStorage
+		{
+			uint64 Epoch;
+			DenseArray Dense;
+			std::vector<Entry*> PageTable;
+			std::vector<Slot> Slots;
+			std::unique_ptr<View> OldView;
+		};
+
+		DenseArray Dense = {};
 		std::vector<Slot> Slots = {};
-		size_t FreeHead = 0;
+		size_t FreeHead = NO_FREE_SLOT;
+		std::vector<Slab> Slabs = {};
+		std::atomic<uint32_t> SlabsUsed = 0;
+		std::atomic<uint32_t> ClaimHead = 0;
+		uint32_t ClaimEnd = 0;
+		EpochDomain* Epochs = nullptr;
+		size_t NumTombstones = 0;
+		std::unique_ptr<View> CurrentView;
+		std::atomic<const View*> Published = nullptr;
+		std::vector<RetiredStorage> Retired;
+
+		V& Resolve(const ElementId& id, const Slot& slot) const
+		{
+			if (slot.IdxOrFree & STAGED_SLOT) [[unlikely]]
+			{
+				const Slab& slab = Slabs[slot.IdxOrFree & ~STAGED_SLOT];
+				return const_cast<V&>(slab.Entries[id.Index - slab.First].second);
+			}
+
+			check(slot.IdxOrFree < Dense.size());
+			return const_cast<V&>(Dense[slot.IdxOrFree].second);
+		}
+
+		void Release(const uint32_t index)
+		{
+			StoreSlot(index, Slot{ .Version = 0, .IdxOrFree = static_cast<uint32_t>(FreeHead) });
+			FreeHead = index;
+		}
+
+		void StoreSlot(const size_t index, const Slot slot)
+		{
+			std::atomic_ref<Slot>(Slots[index]).store(slot, std::memory_order_release);
+		}
+
+		/// Publishes the counts after appending, entries and slots are written before readers can reach them.
+		void SyncView()
+		{
+			if (Epochs)
+			{
+				CurrentView->NumDense.store(static_cast<uint32_t>(Dense.size()), std::memory_order_release);
+				CurrentView->NumSlots.store(static_cast<uint32_t>(Slots.size()), std::memory_order_release);
+			}
+		}
+
+		/// Pages never move, but epoch readers may still index the page table, so a replaced table is retired.
+		void ReserveDense(const size_t count)
+		{
+			if (Epochs)
+			{
+				if (std::vector<Entry*> table = Dense.GrowPageTable(Dense.size() + count); !table.empty())
+				{
+					Republish({}, std::move(table), {});
+				}
+			}
+		}
+
+		void ReserveSlots(const size_t count)
+		{
+			if (Epochs && Slots.size() + count > Slots.capacity())
+			{
+				std::vector<Slot> grown;
+				grown.reserve(std::max<size_t>({ Slots.capacity() * 2, Slots.size() + count, 64 }));
+				grown.insert(grown.end(), Slots.begin(), Slots.end());
+				std::swap(grown, Slots);
+				Republish({}, {}, std::move(grown));
+			}
+		}
+
+		/// Compacts once tombstones make up a quarter of the dense array. Deferred while slabs are reserved, slab
+		/// owners store into the slot vector Compact replaces, MergeSlabs catches up.
+		void CompactIfSparse() requires (EpochReads)
+		{
+			if (Slabs.empty() && NumTombstones > 64 && NumTombstones * 4 > Dense.size())
+			{
+				Compact();
+			}
+		}
+
+		/// Copies live entries and the slots pointing at them into new storage, readers of the old view keep
+		/// a consistent snapshot until it's reclaimed.
+		void Compact() requires (EpochReads)
+		{
+			DenseArray dense;
+			std::vector<Slot> slots;
+			slots.reserve(Slots.capacity());
+			slots.insert(slots.end(), Slots.begin(), Slots.end());
+
+			for (const Entry& entry : Dense)
+			{
+				if (IsLive(entry))
+				{
+					slots[entry.first.Index].IdxOrFree = static_cast<uint32_t>(dense.size());
+					dense.push_back(entry);
+				}
+			}
+
+			std::swap(dense, Dense);
+			std::swap(slots, Slots);
+			NumTombstones = 0;
+			Republish(std::move(dense), {}, std::move(slots));
+		}
+
+		/// Points readers at the current buffers and retires the replaced ones together with the old view.
+		void Republish(DenseArray&& old_dense, std::vector<Entry*>&& old_table, std::vector<Slot>&& old_slots)
+		{
+			std::unique_ptr<View> view = std::make_unique<View>();
+			view->Pages = Dense.GetPageTable();
+			view->Slots = Slots.data();
+			view->NumDense.store(static_cast<uint32_t>(Dense.size()));
+			view->NumSlots.store(static_cast<uint32_t>(Slots.size()));
+
+			Published.store(view.get());
+			std::swap(view, CurrentView);
+
+			if (view)
+			{
+				Retired.push_back(RetiredStorage{ Epochs->Retire(), std::move(old_dense), std::move(old_table), std::move(old_slots), std::move(view) });
+			}
+		}
 
 		// Iterators
 	public:
-		using iterator = typename std::vector<std::pair<ElementId, V>>::iterator;
-		using const_iterator = typename std::vector<std::pair<ElementId, V>>::const_iterator;
-		using reverse_iterator = typename std::vector<std::pair<ElementId, V>>::reverse_iterator;
-		using const_reverse_iterator = typename std::vector<std::pair<ElementId, V>>::const_reverse_iterator;
+		using iterator = typename DenseArray::iterator;
+		using const_iterator = typename DenseArray::const_iterator;
+		using reverse_iterator = std::reverse_iterator<iterator>;
+		using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 		
 		iterator begin() noexcept { return Dense.begin(); }
 		iterator end() noexcept { return Dense.end(); }
 		const_iterator begin() const noexcept { return Dense.begin(); }
 		const_iterator end() const noexcept { return Dense.end(); }
-		const_iterator cbegin() const noexcept { return Dense.cbegin(); }
-		const_iterator cend() const noexcept { return Dense.cend(); }
-		reverse_iterator rbegin() noexcept { return Dense.rbegin(); }
-		reverse_iterator rend() noexcept { return Dense.rend(); }
-		const_reverse_iterator rbegin() const noexcept { return Dense.rbegin(); }
-		const_reverse_iterator rend() const noexcept { return Dense.rend(); }
-		const_reverse_iterator crbegin() const noexcept { return Dense.crbegin(); }
-		const_reverse_iterator crend() const noexcept { return Dense.crend(); }
+		const_iterator cbegin() const noexcept { return Dense.begin(); }
+		const_iterator cend() const noexcept { return Dense.end(); }
+		reverse_iterator rbegin() noexcept { return reverse_iterator(Dense.end()); }
+		reverse_iterator rend() noexcept { return reverse_iterator(Dense.begin()); }
+		const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(Dense.end()); }
+		const_reverse_iterator rend() const noexcept { return const_reverse_iterator(Dense.begin()); }
+		const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+		const_reverse_iterator crend() const noexcept { return rend(); }
 	};
 }
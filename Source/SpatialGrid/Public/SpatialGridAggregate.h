@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#include "SpatialGridTypes.h"
+
+namespace SpatialGrid
+{
+	/// Cells keep running aggregates of their elements when Semantics::Aggregates is true.
+	template<typename GridSemantics>
+	static consteval bool HasAggregates()
+	{
+		if constexpr (requires { GridSemantics::Aggregates; })
+		{
+			return GridSemantics::Aggregates;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	/// Placeholder payload for semantics without Semantics::AggregatePayload.
+	struct NoAggregatePayload
+	{
+		NoAggregatePayload& operator+=(const NoAggregatePayload&) { return *this; }
+		NoAggregatePayload& operator-=(const NoAggregatePayload&) { return *this; }
+	};
+
+	template<typename GridSemantics>
+	struct TAggregatePayload
+	{
+		using Type = NoAggregatePayload;
+
+		template<typename ElementData>
+		static Type Make(const ElementData&) { return Type(); }
+	};
+
+	/// User payload reduced with += / -=, built per element by Semantics::MakeAggregate(const ElementData&).
+	template<typename GridSemantics> requires requires { typename GridSemantics::AggregatePayload; }
+	struct TAggregatePayload<GridSemantics>
+	{
+		using Type = typename GridSemantics::AggregatePayload;
+
+		template<typename ElementData>
+		static Type Make(const ElementData& data) { return GridSemantics::MakeAggregate(data); }
+	};
+
+	template<typename Semantics>
+	struct TAggregate
+	{
+		using Payload = typename TAggregatePayload<Semantics>::Type;
+
+		int32 Count = 0;
+		FVector PositionSum = FVector::ZeroVector;
+		Payload Data = Payload();
+
+		template<typename ElementData>
+		void Add(const FVector& location, const ElementData& data)
+		{
+			Count += 1;
+			PositionSum += location;
+			Data += TAggregatePayload<Semantics>::Make(data);
+		}
+
+		template<typename ElementData>
+		void Remove(const FVector& location, const ElementData& data)
+		{
+			Count -= 1;
+			PositionSum -= location;
+			Data -= TAggregatePayload<Semantics>::Make(data);
+		}
+
+		void Move(const FVector& from, const FVector& to)
+		{
+			PositionSum += to - from;
+		}
+
+		/// Every element moved by `delta`.
+		void ShiftBy(const FVector& delta)
+		{
+			PositionSum += delta * Count;
+		}
+
+		TAggregate& operator+=(const TAggregate& other)
+		{
+			Count += other.Count;
+			PositionSum += other.PositionSum;
+			Data += other.Data;
+			return *this;
+		}
+
+		bool IsEmpty() const { return Count == 0; }
+
+		FVector Centroid() const
+		{
+			return Count > 0 ? PositionSum / Count : FVector::ZeroVector;
+		}
+	};
+
+	/// Stand-in for cells of grids without aggregates, takes no space.
+	struct NoAggregate
+	{
+		template<typename ElementData> void Add(const FVector&, const ElementData&) {}
+		template<typename ElementData> void Remove(const FVector&, const ElementData&) {}
+		void Move(const FVector&, const FVector&) {}
+		void ShiftBy(const FVector&) {}
+	};
+
+	template<typename Semantics>
+	using TCellAggregate = std::conditional_t<HasAggregates<Semantics>(), TAggregate<Semantics>, NoAggregate>;
+}
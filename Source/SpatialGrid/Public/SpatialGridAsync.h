@@ -0,0 +1,159 @@
+﻿#pragma once
+
+#include "Tasks/Task.h"
+#include "SpatialGridLineTrace.h"
+#include "SpatialGridQuery.h"
+
+namespace SpatialGrid
+{
+	/// Results of a launched TAsyncQueryBatch, indexed by the request handles returned when adding requests.
+	struct AsyncQueryResults
+	{
+		/// Hits of a sphere query or multi trace request.
+		TConstArrayView<ElementId> GetElements(const int32 request) const
+		{
+			return TConstArrayView<ElementId>(Elements.GetData() + Offsets[request], Offsets[request + 1] - Offsets[request]);
+		}
+
+		/// Closest hit of a trace request.
+		const QueryResult& GetTraceResult(const int32 request) const
+		{
+			return Traces[request];
+		}
+
+		TArray<ElementId> Elements;
+		TArray<int32> Offsets;
+		TArray<QueryResult> Traces;
+	};
+
+	/**
+	 * Collects sphere queries and traces on the game thread and runs all of them in one task. Each request takes the
+	 * grid lock on its own, so game thread writes only wait for the request in flight rather than the whole batch.
+	 * Every result comes from one consistent grid state, different requests may see the grid before and after a
+	 * write. The grid and the TSphereQuery objects the queries were made from must outlive the task.
+	 */
+	template<typename Semantics>
+	struct TAsyncQueryBatch
+	{
+		using Grid = TSpatialGrid<Semantics>;
+
+		int32 AddSphereQuery(const TQueryIter<Semantics, EQueryCacheType::Cached>& query)
+		{
+			return AddRequest(ERequest::CachedSphere, CachedQueries.Add(query));
+		}
+
+		int32 AddSphereQuery(const TQueryIter<Semantics, EQueryCacheType::UnCached>& query)
+		{
+			return AddRequest(ERequest::UncachedSphere, UncachedQueries.Add(query));
+		}
+
+		/// Closest hit along the line, see TLineTrace::Single.
+		int32 AddTrace(const TLineTrace<Semantics>& trace)
+		{
+			return AddRequest(ERequest::Trace, Traces.Add(trace));
+		}
+
+		/// Every element hit along the line, see TLineTrace::Multi.
+		int32 AddMultiTrace(const TLineTrace<Semantics>& trace)
+		{
+			return AddRequest(ERequest::MultiTrace, Traces.Add(trace));
+		}
+
+		int32 Num() const { return Requests.Num(); }
+		bool IsEmpty() const { return Requests.IsEmpty(); }
+
+		/// Schedules every pending request in one task and empties the batch, the lock is released between requests.
+		UE::Tasks::TTask<TSharedPtr<const AsyncQueryResults>> Launch(const Grid& grid,
+			const UE::Tasks::ETaskPriority priority = UE::Tasks::ETaskPriority::Normal)
+		{
+			return UE::Tasks::Launch(TEXT("SpatialGrid.AsyncQueryBatch"), [&grid, batch = MoveTemp(*this)]
+			{
+				const TSharedPtr<AsyncQueryResults> results = MakeShared<AsyncQueryResults>();
+				batch.Run(grid, *results);
+				return TSharedPtr<const AsyncQueryResults>(results);
+			}, priority);
+		}
+
+	private:
+		enum class ERequest : uint8
+		{
+			CachedSphere,
+			UncachedSphere,
+			Trace,
+			MultiTrace,
+		};
+
+		struct Request
+		{
+			ERequest Type;
+			int32 Index;
+		};
+
+		TArray<Request> Requests;
+		TArray<TQueryIter<Semantics, EQueryCacheType::Cached>> CachedQueries;
+		TArray<TQueryIter<Semantics, EQueryCacheType::UnCached>> UncachedQueries;
+		TArray<TLineTrace<Semantics>> Traces;
+
+		int32 AddRequest(const ERequest type, const int32 index)
+		{
+			return Requests.Add(Request{ type, index });
+		}
+
+		void Run(const Grid& grid, AsyncQueryResults& results) const
+		{
+			results.Offsets.Reserve(Requests.Num() + 1);
+			results.Traces.SetNum(Requests.Num());
+
+			auto add_hit = [&results](const ElementId id, const auto&...)
+			{
+				results.Elements.Add(id);
+			};
+
+			for (int32 index = 0; index < Requests.Num(); ++index)
+			{
+				const Request& request = Requests[index];
+				results.Offsets.Add(results.Elements.Num());
+
+				grid.Locked([&]
+				{
+					switch (request.Type)
+					{
+					case ERequest::CachedSphere: CachedQueries[request.Index].Each(grid, add_hit); break;
+					case ERequest::UncachedSphere: UncachedQueries[request.Index].Each(grid, add_hit); break;
+					case ERequest::Trace: results.Traces[index] = Traces[request.Index].Single(grid); break;
+					case ERequest::MultiTrace: Traces[request.Index].Multi(grid, add_hit); break;
+					}
+				});
+			}
+
+			results.Offsets.Add(results.Elements.Num());
+		}
+	};
+
+	/// Runs one sphere query on a task under the grid lock, the grid and the TSphereQuery must outlive the task.
+	template<typename Semantics, EQueryCacheType CacheType>
+	UE::Tasks::TTask<TArray<ElementId>> LaunchSphereQuery(const TSpatialGrid<Semantics>& grid, const TQueryIter<Semantics, CacheType>& query,
+		const UE::Tasks::ETaskPriority priority = UE::Tasks::ETaskPriority::Normal)
+	{
+		return UE::Tasks::Launch(TEXT("SpatialGrid.SphereQuery"), [&grid, query]
+		{
+			TArray<ElementId> hits;
+			grid.Locked([&]
+			{
+				query.Each(grid, [&hits](const ElementId id, const auto&) { hits.Add(id); });
+			});
+			return hits;
+		}, priority);
+	}
+
+	/// Finds the closest hit along a line on a task under the grid lock, the grid must outlive the task.
+	template<typename Semantics>
+	UE::Tasks::TTask<QueryResult> LaunchTrace(const TSpatialGrid<Semantics>& grid, const TLineTrace<Semantics>& trace,
+		const UE::Tasks::ETaskPriority priority = UE::Tasks::ETaskPriority::Normal)
+	{
+		return UE::Tasks::Launch(TEXT("SpatialGrid.Trace"), [&grid, trace]
+		{
+			return grid.Locked([&] { return trace.Single(grid); });
+		}, priority);
+	}
+}
@@ -0,0 +1,103 @@
+﻿#pragma once
+
+#include "SpatialGridQuery.h"
+
+namespace SpatialGrid
+{
+	/**
+	 * Elements overlapping a capsule between two points, e.g. melee sweeps or swept movement volumes.
+	 * Cells are enumerated slice by slice along the dominant axis of the segment, so every cell within reach
+	 * of the segment is visited exactly once, then run through the stages shared with the sphere query.
+	 */
+	template<typename Semantics>
+	struct TCapsuleQuery
+	{
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using Stages	= TQueryStages<Semantics>;
+
+		TCapsuleQuery(const FVector& start, const FVector& end, const double radius) : Shape{ start, end, radius } {}
+
+		/// This function is not thread safe!!!
+		template<typename F>
+		void Each(const Grid& grid, F&& func) const
+		{
+			TOversizedVisits<Semantics> visits;
+
+			ForEachCellCoord(grid, [&](const CellIndex& coords)
+			{
+				if (const Cell* cell = grid.GetCell(coords))
+				{
+					Stages::ScanCell(grid, *cell, Shape, visits, func);
+				}
+			});
+		}
+
+		/// Calls func(coords) once for every cell that can store an element overlapping the capsule.
+		template<typename F>
+		void ForEachCellCoord(const Grid& grid, F&& func) const
+		{
+			const FVector start = grid.LocationToCellSpace(Shape.Start);
+			const FVector end = grid.LocationToCellSpace(Shape.End);
+			const FVector dir = end - start;
+			const double reach = (Shape.Radius + Semantics::MaxElementRadius) / grid.CellSize();
+
+			const FVector abs = dir.GetAbs();
+			const int32 major = abs.X >= abs.Y && abs.X >= abs.Z ? 0 : (abs.Y >= abs.Z ? 1 : 2);
+			const int32 axis_a = (major + 1) % 3;
+			const int32 axis_b = (major + 2) % 3;
+
+			const int32 first = FMath::CeilToInt32(FMath::Min(start[major], end[major]) - reach - 0.5);
+			const int32 last = FMath::FloorToInt32(FMath::Max(start[major], end[major]) + reach + 0.5);
+
+			for (int32 slice = first; slice <= last; ++slice)
+			{
+				// Part of the segment close enough along the major axis to reach into this slice.
+				double t0 = 0., t1 = 1.;
+
+				if (dir[major] != 0.)
+				{
+					const double lo = (slice - 0.5 - reach - start[major]) / dir[major];
+					const double hi = (slice + 0.5 + reach - start[major]) / dir[major];
+					t0 = FMath::Max(FMath::Min(lo, hi), 0.);
+					t1 = FMath::Min(FMath::Max(lo, hi), 1.);
+
+					if (t0 > t1)
+					{
+						continue;
+					}
+				}
+
+				const FVector p0 = start + dir * t0;
+				const FVector p1 = start + dir * t1;
+
+				int32 min_a = FMath::CeilToInt32(FMath::Min(p0[axis_a], p1[axis_a]) - reach - 0.5);
+				int32 max_a = FMath::FloorToInt32(FMath::Max(p0[axis_a], p1[axis_a]) + reach + 0.5);
+				int32 min_b = FMath::CeilToInt32(FMath::Min(p0[axis_b], p1[axis_b]) - reach - 0.5);
+				int32 max_b = FMath::FloorToInt32(FMath::Max(p0[axis_b], p1[axis_b]) + reach + 0.5);
+
+				// Planar grids only store layer 0, the segment was flattened onto it and never picks Z as major axis.
+				if constexpr (IsPlanar<Semantics>())
+				{
+					(axis_a == 2 ? min_a : min_b) = 0;
+					(axis_a == 2 ? max_a : max_b) = 0;
+				}
+
+				for (int32 b = min_b; b <= max_b; ++b)
+				{
+					for (int32 a = min_a; a <= max_a; ++a)
+					{
+						CellIndex coords;
+						coords[major] = slice;
+						coords[axis_a] = a;
+						coords[axis_b] = b;
+						func(coords);
+					}
+				}
+			}
+		}
+
+	private:
+		CapsuleShape Shape;
+	};
+}
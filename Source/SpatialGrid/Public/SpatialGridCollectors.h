@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include "SpatialGridTypes.h"
+
+namespace SpatialGrid
+{
+	/**
+	 * Collectors receive query hits through Add(id, element) and stop the query once IsFull() returns true.
+	 * A collector providing AddCount(n) only counts, queries then take cells completely inside the shape
+	 * as a whole without reading their elements.
+	 */
+	template<typename Collector>
+	static consteval bool CountsOnly()
+	{
+		return requires(Collector& collector) { collector.AddCount(int32()); };
+	}
+
+	/// Keeps the first Capacity hits in place without allocating.
+	template<int32 Capacity>
+	struct TInlineCollector
+	{
+		static_assert(Capacity > 0, "inline collector needs room for at least one hit");
+
+		template<typename Element>
+		void Add(const ElementId id, const Element&)
+		{
+			Ids[Count++] = id;
+		}
+
+		bool IsFull() const { return Count >= Capacity; }
+		int32 Num() const { return Count; }
+
+		TConstArrayView<ElementId> GetIds() const
+		{
+			return TConstArrayView<ElementId>(Ids, Count);
+		}
+
+	private:
+		ElementId Ids[Capacity];
+		int32 Count = 0;
+	};
+
+	/// Number of hits, never touches element payloads.
+	struct CountCollector
+	{
+		template<typename Element>
+		void Add(const ElementId, const Element&)
+		{
+			++Count;
+		}
+
+		void AddCount(const int32 count)
+		{
+			Count += count;
+		}
+
+		bool IsFull() const { return false; }
+		int32 Num() const { return Count; }
+
+	private:
+		int32 Count = 0;
+	};
+
+	/// Stops at the first hit.
+	struct AnyHitCollector
+	{
+		template<typename Element>
+		void Add(const ElementId id, const Element&)
+		{
+			Hit = id;
+			Found = true;
+		}
+
+		bool IsFull() const { return Found; }
+		bool HasHit() const { return Found; }
+		ElementId GetHit() const { return Hit; }
+
+	private:
+		ElementId Hit;
+		bool Found = false;
+	};
+
+	/// Writes ids and positions of the hits into caller provided arrays, stops once they are full.
+	struct GatherCollector
+	{
+		GatherCollector(TArrayView<ElementId> ids, TArrayView<FVector> positions)
+		: Ids(ids)
+		, Positions(positions)
+		, Capacity(FMath::Min(ids.Num(), positions.Num())) {}
+
+		template<typename Element>
+		void Add(const ElementId id, const Element& element)
+		{
+			Ids[Count] = id;
+			Positions[Count] = element.Bounds.Origin;
+			++Count;
+		}
+
+		bool IsFull() const { return Count >= Capacity; }
+		int32 Num() const { return Count; }
+
+	private:
+		TArrayView<ElementId> Ids;
+		TArrayView<FVector> Positions;
+		int32 Capacity = 0;
+		int32 Count = 0;
+	};
+}
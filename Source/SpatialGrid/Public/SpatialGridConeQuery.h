@@ -0,0 +1,319 @@
+﻿#pragma once
+
+#include "Grid.h"
+#include "SpatialGridUtils.h"
+
+namespace SpatialGrid
+{
+	template<typename Semantics>
+	struct TConeQuery;
+
+	template<typename Semantics>
+	struct TConeQueryBuilder;
+
+	/// Apex, axis and opening of a cone, shared by the cell stencils and the element test.
+	struct ConeShape
+	{
+		ConeShape(const double radius, const double half_angle)
+		: Radius(radius)
+		, Cos(FMath::Cos(half_angle))
+		, Sin(FMath::Sin(half_angle)) {}
+
+		/// True if a sphere of `sphere_radius` at `offset` from the apex overlaps the spherical sector along `dir`.
+		bool OverlapsSphere(const FVector& offset, const FVector& dir, const double sphere_radius) const
+		{
+			const double dist_sq = offset.SizeSquared();
+
+			if (dist_sq > FMath::Square(Radius + sphere_radius))
+			{
+				return false;
+			}
+
+			const double along = offset | dir;
+
+			// Center inside the cone, decided without a square root.
+			const double cone_sq = dist_sq * Cos * Cos;
+			if (Cos >= 0. ? (along >= 0. && along * along >= cone_sq) : (along >= 0. || along * along <= cone_sq))
+			{
+				return true;
+			}
+
+			const double perp = FMath::Sqrt(FMath::Max(dist_sq - along * along, 0.));
+
+			// Closest point of the cone surface is the apex itself.
+			if (along * Cos + perp * Sin < 0.)
+			{
+				return dist_sq <= sphere_radius * sphere_radius;
+			}
+
+			return perp * Cos - along * Sin <= sphere_radius;
+		}
+
+		double Radius;
+		double Cos;
+		double Sin;
+	};
+
+	template<typename Semantics>
+	struct TConeQueryIter
+	{
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using Element	= typename Grid::Element;
+		using QueryType	= TConeQuery<Semantics>;
+
+		TConeQueryIter(const QueryType* query, const FVector& origin, const FVector& direction)
+		: Query(query)
+		, Origin(origin)
+		, Direction(direction.GetSafeNormal()) {}
+
+		/// This function is not thread safe!!!
+		template<typename F>
+		void Each(const Grid& grid, F&& func) const
+		{
+			if (!Query || Direction.IsZero()) { return; }
+
+			const CellIndex offset = grid.LocationToCoordinates(Origin);
+			TOversizedVisits<Semantics> visits;
+
+			auto scan_cell = [&](const CellIndex& coords)
+			{
+				if (const Cell* cell = grid.GetCell(coords))
+				{
+					cell->ForEachElement(grid, visits, [&](const ElementId id, const Element& element)
+					{
+						if (Query->Shape.OverlapsSphere(element.Bounds.Origin - Origin, Direction, element.Bounds.GetRadius()))
+						{
+							func(id, element);
+						}
+					});
+				}
+			};
+
+			if (Query->HasStencilFor(grid))
+			{
+				for (const CellIndex& cell_coord : Query->Stencil(Direction))
+				{
+					scan_cell(cell_coord + offset);
+				}
+			}
+			else
+			{
+				// Stencils built for another cell size, every cell in range is tested.
+				NeighbourRange<Semantics>(FMath::RoundToInt32(Query->Shape.Radius / grid.CellSize()) + 1).ForEach(offset, scan_cell);
+			}
+		}
+
+	private:
+		const QueryType* Query = nullptr;
+		FVector Origin = FVector::ZeroVector;
+		FVector Direction = FVector::ZeroVector;
+	};
+
+	/**
+	 * Spherical sector query. Cell stencils are cached per quantized direction, directions are bucketed on the
+	 * faces of a cube with Resolution x Resolution buckets per face, so cells behind the observer are never visited.
+	 * Planar grids bucket the heading into 4 x Resolution steps and the elevation into Resolution bands, each stencil
+	 * covers the footprint of the cone on the plane.
+	 * Sphere elements are tested exactly. Box elements are tested by their bounding sphere, so boxes near the rim can be
+	 * reported without touching the sector, callers that need exact results re-test the box against the sector.
+	 */
+	template<typename Semantics>
+	struct TConeQuery
+	{
+		TConeQueryIter<Semantics> SetOrigin(const FVector& origin, const FVector& direction) const
+		{
+			return TConeQueryIter<Semantics>(this, origin, direction);
+		}
+
+		int32 NumStencils() const { return Stencils.Num(); }
+
+		/// Stencils are in cells of the size they were built for, see TConeQueryBuilder::SetCellSize.
+		bool HasStencilFor(const TSpatialGrid<Semantics>& grid) const
+		{
+			return !HasRuntimeCellSize<Semantics>() || grid.CellSize() == CellSize;
+		}
+
+	private:
+		TConeQuery(const double radius, const double half_angle, const int32 resolution, const double cell_size)
+		: Shape(radius, half_angle)
+		, Resolution(resolution)
+		, CellSize(cell_size) {}
+
+		ConeShape Shape;
+		int32 Resolution = 1;
+		double CellSize = Semantics::CellSize;
+		TArray<TArray<CellIndex>> Stencils;
+
+		const TArray<CellIndex>& Stencil(const FVector& dir) const
+		{
+			if constexpr (IsPlanar<Semantics>())
+			{
+				return Stencils[PlanarDirectionToBucket(dir, Resolution)];
+			}
+			else
+			{
+				return Stencils[DirectionToBucket(dir, Resolution)];
+			}
+		}
+
+		/// Cube face of the dominant axis, then the position on that face quantized to Resolution steps.
+		static int32 DirectionToBucket(const FVector& dir, const int32 resolution)
+		{
+			const FVector abs = dir.GetAbs();
+			const int32 axis = abs.X >= abs.Y && abs.X >= abs.Z ? 0 : (abs.Y >= abs.Z ? 1 : 2);
+			const int32 face = axis * 2 + (dir[axis] < 0. ? 1 : 0);
+			const double u = dir[(axis + 1) % 3] / abs[axis];
+			const double v = dir[(axis + 2) % 3] / abs[axis];
+			const int32 iu = FMath::Clamp(FMath::FloorToInt32((u + 1.) * 0.5 * resolution), 0, resolution - 1);
+			const int32 iv = FMath::Clamp(FMath::FloorToInt32((v + 1.) * 0.5 * resolution), 0, resolution - 1);
+			return (face * resolution + iu) * resolution + iv;
+		}
+
+		/// Elevation band of the direction, then its heading quantized to 4 x Resolution steps around the circle.
+		static int32 PlanarDirectionToBucket(const FVector& dir, const int32 resolution)
+		{
+			const double elevation = FMath::Asin(FMath::Clamp(FMath::Abs(dir.Z), 0., 1.));
+			const int32 band = FMath::Clamp(FMath::FloorToInt32(elevation / UE_HALF_PI * resolution), 0, resolution - 1);
+			const double heading = FMath::Atan2(dir.Y, dir.X);
+			const int32 steps = 4 * resolution;
+			const int32 step = FMath::Clamp(FMath::FloorToInt32((heading + UE_PI) / UE_TWO_PI * steps), 0, steps - 1);
+			return band * steps + step;
+		}
+
+		static FVector BucketDirection(const int32 face, const double u, const double v)
+		{
+			const int32 axis = face / 2;
+			FVector dir;
+			dir[axis] = (face % 2) ? -1. : 1.;
+			dir[(axis + 1) % 3] = u;
+			dir[(axis + 2) % 3] = v;
+			return dir.GetSafeNormal();
+		}
+
+		friend struct TConeQueryIter<Semantics>;
+		friend struct TConeQueryBuilder<Semantics>;
+	};
+
+	template<typename Semantics>
+	struct TConeQueryBuilder
+	{
+		using Self = TConeQueryBuilder;
+
+		Self& SetRadius(const double radius)
+		{
+			Radius = radius;
+			return *this;
+		}
+
+		Self& SetHalfAngleDegrees(const double half_angle)
+		{
+			HalfAngle = FMath::DegreesToRadians(FMath::Clamp(half_angle, 0., 180.));
+			return *this;
+		}
+
+		/// Direction buckets per cube face side, or elevation bands and heading steps per quadrant on planar grids,
+		/// more buckets give tighter stencils at the cost of memory.
+		Self& SetDirectionResolution(const int32 resolution)
+		{
+			Resolution = FMath::Max(resolution, 1);
+			return *this;
+		}
+
+		/// Cell size the stencils are built for, pass grid.CellSize() for grids with Semantics::RuntimeCellSize.
+		Self& SetCellSize(const double cell_size) requires (HasRuntimeCellSize<Semantics>())
+		{
+			CellSize = cell_size;
+			return *this;
+		}
+
+		TConeQuery<Semantics> Build() const
+		{
+			TConeQuery<Semantics> query(Radius, HalfAngle, Resolution, CellSize);
+
+			const int32 bounds = FMath::RoundToInt32(Radius / CellSize) + 1;
+			// Cell bounding sphere, grown by the worst case apex position within the origin cell.
+			const double cell_reach = 2. * SpatialGrid::HalfDiagonal<Semantics>(CellSize) + Semantics::MaxElementRadius;
+
+			if constexpr (IsPlanar<Semantics>())
+			{
+				// Columns span every height, so a stencil covers the footprint of the cone on the plane: a sector
+				// around the heading, wider the steeper the cone, up to the full disc once it reaches the vertical.
+				const int32 steps = 4 * Resolution;
+				const double step = UE_TWO_PI / steps;
+				query.Stencils.SetNum(Resolution * steps);
+
+				for (int32 band = 0; band < Resolution; ++band)
+				{
+					const double elevation = (band + 1) * UE_HALF_PI / Resolution;
+					const double footprint = HalfAngle + elevation >= UE_HALF_PI
+						? UE_PI : FMath::Asin(FMath::Min(FMath::Sin(HalfAngle) / FMath::Cos(elevation), 1.));
+
+					for (int32 heading = 0; heading < steps; ++heading)
+					{
+						const double angle = -UE_PI + (heading + 0.5) * step;
+						const FVector axis(FMath::Cos(angle), FMath::Sin(angle), 0.);
+						const ConeShape shape(Radius, FMath::Min(footprint + step * 0.5, UE_PI));
+						TArray<CellIndex>& stencil = query.Stencils[band * steps + heading];
+
+						NeighbourRange<Semantics>(bounds).ForEach([&](const CellIndex& index)
+						{
+							if (shape.OverlapsSphere(FVector(index) * CellSize, axis, cell_reach))
+							{
+								stencil.Add(index);
+							}
+						});
+					}
+				}
+			}
+			else
+			{
+				const double step = 2. / Resolution;
+				query.Stencils.SetNum(6 * Resolution * Resolution);
+
+				for (int32 face = 0; face < 6; ++face)
+				{
+					for (int32 iu = 0; iu < Resolution; ++iu)
+					{
+						for (int32 iv = 0; iv < Resolution; ++iv)
+						{
+							const double u0 = -1. + iu * step;
+							const double v0 = -1. + iv * step;
+							const FVector axis = TConeQuery<Semantics>::BucketDirection(face, u0 + step * 0.5, v0 + step * 0.5);
+
+							// Widen the cone by the largest angle between the bucket axis and any direction in the bucket.
+							double spread = 0.;
+							for (const FVector& corner : {
+								TConeQuery<Semantics>::BucketDirection(face, u0, v0),
+								TConeQuery<Semantics>::BucketDirection(face, u0 + step, v0),
+								TConeQuery<Semantics>::BucketDirection(face, u0, v0 + step),
+								TConeQuery<Semantics>::BucketDirection(face, u0 + step, v0 + step) })
+							{
+								spread = FMath::Max(spread, FMath::Acos(FMath::Clamp(corner | axis, -1., 1.)));
+							}
+
+							const ConeShape shape(Radius, FMath::Min(HalfAngle + spread, UE_PI));
+							TArray<CellIndex>& stencil = query.Stencils[(face * Resolution + iu) * Resolution + iv];
+
+							CellRange(bounds).ForEach([&](const CellIndex& index)
+							{
+								if (shape.OverlapsSphere(FVector(index) * CellSize, axis, cell_reach))
+								{
+									stencil.Add(index);
+								}
+							});
+						}
+					}
+				}
+			}
+
+			return query;
+		}
+
+	private:
+		double Radius = Semantics::CellSize;
+		double HalfAngle = UE_HALF_PI * 0.5;
+		int32 Resolution = 4;
+		double CellSize = Semantics::CellSize;
+	};
+}
@@ -0,0 +1,218 @@
+﻿#pragma once
+
+#include "Grid.h"
+#include "SpatialGridUtils.h"
+
+namespace SpatialGrid
+{
+	/**
+	 * Elements overlapping a convex volume given by up to MaxPlanes planes with outward facing normals,
+	 * a point is inside when PlaneDot(point) <= 0 for every plane (same convention as FConvexVolume).
+	 * The planes must enclose a finite volume, e.g. a frustum including its far plane.
+	 * Covered cells are rasterized conservatively from the volume bounds, cells completely inside skip the
+	 * per-element tests and partially covered cells test elements against all planes four at a time.
+	 * Results are conservative. Elements are tested by their bounding sphere against each plane on its own, so
+	 * spheres beyond an edge or corner of the volume and boxes whose bounding sphere crosses a plane are reported
+	 * too. Callers that need exact results re-test the element bounds against the volume, e.g. with
+	 * FConvexVolume::IntersectBox.
+	 */
+	template<typename Semantics, int32 MaxPlanes = 8>
+	struct TConvexQuery
+	{
+		static_assert(MaxPlanes > 0, "convex query needs at least one plane");
+
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using Element	= typename Grid::Element;
+
+		explicit TConvexQuery(TConstArrayView<FPlane> planes)
+		{
+			checkf(planes.Num() <= MaxPlanes, TEXT("convex query supports at most %d planes"), MaxPlanes);
+			NumPlanes = FMath::Min(planes.Num(), MaxPlanes);
+
+			// Unused lanes keep a zero plane which never rejects anything.
+			for (int32 i = 0; i < NumPlanes; ++i)
+			{
+				PlaneX[i] = planes[i].X;
+				PlaneY[i] = planes[i].Y;
+				PlaneZ[i] = planes[i].Z;
+				PlaneW[i] = planes[i].W;
+			}
+
+			VolumeBounds = ComputeBounds();
+		}
+
+		/// Bounds of the volume vertices, invalid if no three planes meet inside the volume.
+		const FBox& GetBounds() const
+		{
+			return VolumeBounds;
+		}
+
+		/// This function is not thread safe!!!
+		template<typename F>
+		void Each(const Grid& grid, F&& func) const
+		{
+			if (!VolumeBounds.IsValid)
+			{
+				return;
+			}
+
+			const FBox reach = VolumeBounds.ExpandBy(Semantics::MaxElementRadius);
+			const CellIndex min = grid.LocationToCoordinates(reach.Min);
+			const CellIndex max = grid.LocationToCoordinates(reach.Max);
+			const int64 cell_count = int64(max.X - min.X + 1) * (max.Y - min.Y + 1) * (max.Z - min.Z + 1);
+			TOversizedVisits<Semantics> visits;
+
+			auto scan_cell = [&](const CellIndex&, const Cell& cell)
+			{
+				if (cell.HasElements())
+				{
+					ScanCell(grid, cell, visits, func);
+				}
+			};
+
+			if (cell_count > grid.NumCells())
+			{
+				grid.ForEachCell(scan_cell);
+				return;
+			}
+
+			for (int32 z = min.Z; z <= max.Z; ++z)
+			{
+				for (int32 y = min.Y; y <= max.Y; ++y)
+				{
+					for (int32 x = min.X; x <= max.X; ++x)
+					{
+						if (const Cell* cell = grid.GetCell(CellIndex(x, y, z)))
+						{
+							scan_cell(CellIndex(x, y, z), *cell);
+						}
+					}
+				}
+			}
+		}
+
+		/// True if a sphere at `origin` is not completely behind any plane.
+		bool OverlapsSphere(const FVector& origin, const double radius) const
+		{
+			const VectorRegister4Double x = VectorLoadFloat1(&origin.X);
+			const VectorRegister4Double y = VectorLoadFloat1(&origin.Y);
+			const VectorRegister4Double z = VectorLoadFloat1(&origin.Z);
+			const VectorRegister4Double r = VectorSetFloat1(radius);
+
+			for (int32 i = 0; i < NumPlanes; i += 4)
+			{
+				VectorRegister4Double dist = VectorMultiply(VectorLoadAligned(&PlaneX[i]), x);
+				dist = VectorMultiplyAdd(VectorLoadAligned(&PlaneY[i]), y, dist);
+				dist = VectorMultiplyAdd(VectorLoadAligned(&PlaneZ[i]), z, dist);
+				dist = VectorSubtract(dist, VectorLoadAligned(&PlaneW[i]));
+
+				if (VectorMaskBits(VectorCompareGT(dist, r)))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+	private:
+		static constexpr int32 PaddedPlanes = (MaxPlanes + 3) & ~3;
+
+		alignas(32) double PlaneX[PaddedPlanes] = {};
+		alignas(32) double PlaneY[PaddedPlanes] = {};
+		alignas(32) double PlaneZ[PaddedPlanes] = {};
+		alignas(32) double PlaneW[PaddedPlanes] = {};
+		int32 NumPlanes = 0;
+		FBox VolumeBounds;
+
+		enum class ECellCoverage : uint8
+		{
+			Outside,
+			Partial,
+			Inside,
+		};
+
+		ECellCoverage Classify(const FBox& box) const
+		{
+			const FVector center = box.GetCenter();
+			const FVector extent = box.GetExtent();
+			ECellCoverage coverage = ECellCoverage::Inside;
+
+			for (int32 i = 0; i < NumPlanes; ++i)
+			{
+				const double dist = PlaneX[i] * center.X + PlaneY[i] * center.Y + PlaneZ[i] * center.Z - PlaneW[i];
+				const double push = FMath::Abs(PlaneX[i]) * extent.X + FMath::Abs(PlaneY[i]) * extent.Y + FMath::Abs(PlaneZ[i]) * extent.Z;
+
+				if (dist - push > Semantics::MaxElementRadius)
+				{
+					return ECellCoverage::Outside;
+				}
+
+				if (dist + push > 0.)
+				{
+					coverage = ECellCoverage::Partial;
+				}
+			}
+
+			return coverage;
+		}
+
+		template<typename F>
+		void ScanCell(const Grid& grid, const Cell& cell, TOversizedVisits<Semantics>& visits, F& func) const
+		{
+			switch (Classify(cell.GetBounds()))
+			{
+			case ECellCoverage::Outside:
+				return;
+			case ECellCoverage::Inside:
+				cell.ForEachElement(grid, visits, func);
+				return;
+			case ECellCoverage::Partial:
+				cell.ForEachElement(grid, visits, [&](const ElementId id, const Element& element)
+				{
+					if (OverlapsSphere(element.Bounds.Origin, element.Bounds.GetRadius()))
+					{
+						func(id, element);
+					}
+				});
+				return;
+			}
+		}
+
+		/// AABB of the polytope vertices, found by intersecting every triple of planes.
+		FBox ComputeBounds() const
+		{
+			FBox bounds(ForceInit);
+
+			for (int32 i = 0; i < NumPlanes; ++i)
+			{
+				for (int32 j = i + 1; j < NumPlanes; ++j)
+				{
+					for (int32 k = j + 1; k < NumPlanes; ++k)
+					{
+						const FVector n_i(PlaneX[i], PlaneY[i], PlaneZ[i]);
+						const FVector n_j(PlaneX[j], PlaneY[j], PlaneZ[j]);
+						const FVector n_k(PlaneX[k], PlaneY[k], PlaneZ[k]);
+						const FVector jk = n_j ^ n_k;
+						const double det = n_i | jk;
+
+						if (FMath::IsNearlyZero(det))
+						{
+							continue;
+						}
+
+						const FVector vertex = (jk * PlaneW[i] + (n_k ^ n_i) * PlaneW[j] + (n_i ^ n_j) * PlaneW[k]) / det;
+
+						if (OverlapsSphere(vertex, UE_KINDA_SMALL_NUMBER * FMath::Max(1., vertex.GetAbsMax())))
+						{
+							bounds += vertex;
+						}
+					}
+				}
+			}
+
+			return bounds;
+		}
+	};
+}
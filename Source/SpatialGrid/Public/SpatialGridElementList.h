@@ -0,0 +1,146 @@
+﻿#pragma once
+
+#include "SpatialGridTypes.h"
+#include <memory>
+
+namespace SpatialGrid
+{
+	/**
+	 * Unordered element ids of a cell. Up to InlineCapacity ids live inside the list, larger cells spill to a heap
+	 * buffer from `Allocator` and move back inline once they shrink to half of it.
+	 * Indices are stable until RemoveAtSwap, which moves the last id into the hole, the owner keeps a back index
+	 * per element to find and patch them.
+	 */
+	template<int32 InlineCapacity, typename Allocator = std::allocator<ElementId>>
+	struct TElementIdList
+	{
+		static_assert(InlineCapacity >= 2, "inline capacity has to hold at least two ids");
+
+		explicit TElementIdList(const Allocator& allocator = Allocator()) : Alloc(allocator) {}
+
+		TElementIdList(TElementIdList&& other) noexcept
+		: Count(other.Count)
+		, Capacity(other.Capacity)
+		, Alloc(other.Alloc)
+		{
+			if (IsInline())
+			{
+				std::copy_n(other.Inline, Count, Inline);
+			}
+			else
+			{
+				Heap = other.Heap;
+			}
+
+			other.Count = 0;
+			other.Capacity = InlineCapacity;
+		}
+
+		TElementIdList& operator=(TElementIdList&& other) noexcept
+		{
+			if (this != &other)
+			{
+				this->~TElementIdList();
+				new (this) TElementIdList(std::move(other));
+			}
+			return *this;
+		}
+
+		TElementIdList(const TElementIdList&) = delete;
+		TElementIdList& operator=(const TElementIdList&) = delete;
+
+		~TElementIdList()
+		{
+			if (!IsInline())
+			{
+				std::allocator_traits<Allocator>::deallocate(Alloc, Heap, Capacity);
+			}
+		}
+
+		int32 Num() const { return Count; }
+		bool IsEmpty() const { return Count == 0; }
+
+		const ElementId& operator[](const int32 index) const
+		{
+			check(index < Count);
+			return GetData()[index];
+		}
+
+		/// Appends `id` and returns its index.
+		int32 Add(const ElementId id)
+		{
+			if (Count == Capacity)
+			{
+				Reallocate(Capacity * 2);
+			}
+
+			GetData()[Count] = id;
+			return Count++;
+		}
+
+		/// Removes the id at `index` by moving the last one into its place. Returns the moved id, whose index is
+		/// now `index`, or an invalid id if `index` was the last one.
+		ElementId RemoveAtSwap(const int32 index)
+		{
+			check(index < Count);
+
+			ElementId* data = GetData();
+			Count -= 1;
+			const ElementId moved = index != Count ? data[Count] : ElementId();
+			data[index] = data[Count];
+
+			if (!IsInline() && Count <= InlineCapacity / 2)
+			{
+				Reallocate(InlineCapacity);
+			}
+
+			return moved;
+		}
+
+		const ElementId* begin() const { return GetData(); }
+		const ElementId* end() const { return GetData() + Count; }
+
+	private:
+		int32 Count = 0;
+		int32 Capacity = InlineCapacity;
+		union
+		{
+			ElementId Inline[InlineCapacity];
+			ElementId* Heap;
+		};
+		UE_NO_UNIQUE_ADDRESS Allocator Alloc;
+
+		bool IsInline() const { return Capacity == InlineCapacity; }
+
+		ElementId* GetData() { return IsInline() ? Inline : Heap; }
+		const ElementId* GetData() const { return IsInline() ? Inline : Heap; }
+
+		void Reallocate(const int32 capacity)
+		{
+			ElementId* const old_data = GetData();
+			const bool was_inline = IsInline();
+			const int32 old_capacity = Capacity;
+
+			if (capacity == InlineCapacity)
+			{
+				ElementId ids[InlineCapacity];
+				std::copy_n(old_data, Count, ids);
+				std::allocator_traits<Allocator>::deallocate(Alloc, old_data, old_capacity);
+				std::copy_n(ids, Count, Inline);
+			}
+			else
+			{
+				ElementId* data = std::allocator_traits<Allocator>::allocate(Alloc, capacity);
+				std::copy_n(old_data, Count, data);
+
+				if (!was_inline)
+				{
+					std::allocator_traits<Allocator>::deallocate(Alloc, old_data, old_capacity);
+				}
+				Heap = data;
+			}
+
+			Capacity = capacity;
+		}
+	};
+}
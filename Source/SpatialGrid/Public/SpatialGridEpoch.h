@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+namespace SpatialGrid
+{
+	/**
+	 * Epoch based reclamation for storage read without locks.
+	 * Readers pin the current epoch for the lifetime of a ReadGuard. A writer that unpublishes memory calls Retire()
+	 * and keeps the memory alive until SafeEpoch() is greater than the returned epoch, at that point no reader
+	 * that could still see it is left.
+	 */
+	struct SPATIALGRID_API EpochDomain
+	{
+		static constexpr int32 MaxReaders = 64;
+
+		/// Pins the epoch current at construction until destroyed. Waits if MaxReaders guards are alive already.
+		struct SPATIALGRID_API ReadGuard
+		{
+			explicit ReadGuard(const EpochDomain& domain) : Domain(&domain), Reader(domain.Pin()) {}
+			ReadGuard(ReadGuard&& other) : Domain(other.Domain), Reader(other.Reader) { other.Domain = nullptr; }
+			ReadGuard(const ReadGuard&) = delete;
+			ReadGuard& operator=(const ReadGuard&) = delete;
+			ReadGuard& operator=(ReadGuard&&) = delete;
+
+			~ReadGuard()
+			{
+				if (Domain)
+				{
+					Domain->Unpin(Reader);
+				}
+			}
+
+		private:
+			const EpochDomain* Domain;
+			int32 Reader;
+		};
+
+		EpochDomain() = default;
+		EpochDomain(const EpochDomain&) = delete;
+		EpochDomain& operator=(const EpochDomain&) = delete;
+
+		/// Ends the current epoch and returns it. Call after the retired memory was unpublished.
+		uint64 Retire();
+
+		/// Smallest epoch pinned by any reader, the current epoch if there are none.
+		uint64 SafeEpoch() const;
+
+	private:
+		struct alignas(PLATFORM_CACHE_LINE_SIZE) ReaderSlot
+		{
+			/// 0 while unused.
+			std::atomic<uint64> Epoch = 0;
+		};
+
+		std::atomic<uint64> Epoch = 1;
+		mutable ReaderSlot Readers[MaxReaders];
+
+		int32 Pin() const;
+		void Unpin(int32 reader) const;
+	};
+}
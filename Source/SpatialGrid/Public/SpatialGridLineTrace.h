@@ -2,10 +2,14 @@
 
 #include "Grid.h"
 #include "SpatialGridQueryResult.h"
+#include "SpatialGridRange.h"
 #include "SpatialGridUtils.h"
 
 namespace SpatialGrid
 {
+	template<typename Semantics>
+	struct TLineTraceView;
+
 	template<typename Semantics>
 	struct TLineTrace
 	{
@@ -19,10 +23,6 @@ namespace SpatialGrid
 		, End(end)
 		, Dir((end - start).GetSafeNormal())
 		, InvDir(Dir.Reciprocal())
-		, Delta(
-			FMath::Abs(Semantics::CellSize * InvDir.X),
-			FMath::Abs(Semantics::CellSize * InvDir.Y),
-			FMath::Abs(Semantics::CellSize * InvDir.Z))
 		, Step(Dir.X > 0 ? 1 : -1, Dir.Y > 0 ? 1 : -1, Dir.Z > 0 ? 1 : -1) {}
 		
 		TLineTrace(const FVector& start, const FVector& direction, const double length)
@@ -30,10 +30,6 @@ namespace SpatialGrid
 		, End(start + (direction * length))
 		, Dir(direction)
 		, InvDir(Dir.Reciprocal())
-		, Delta(
-			FMath::Abs(Semantics::CellSize * InvDir.X),
-			FMath::Abs(Semantics::CellSize * InvDir.Y),
-			FMath::Abs(Semantics::CellSize * InvDir.Z))
 		, Step(Dir.X > 0 ? 1 : -1, Dir.Y > 0 ? 1 : -1, Dir.Z > 0 ? 1 : -1) {}
 		
 		template<typename IterFunc>
@@ -50,32 +46,42 @@ namespace SpatialGrid
 			CellSet   checked_cells(100);
 			CellIndex current_cell = grid.LocationToCoordinates(hit_point);
 			const FVector start_cell_origin = grid.CellCenter(current_cell);
+			const FVector cell_extent = SpatialGrid::CellExtent<Semantics>(grid.CellSize());
 			const FVector t1 = ((start_cell_origin - cell_extent) - hit_point) * InvDir;
 			const FVector t2 = ((start_cell_origin + cell_extent) - hit_point) * InvDir;
 			const CellIndex end_cell = grid.LocationToCoordinates(End);
+			const FVector delta = CellDelta(grid);
 
 			FVector t_max = FVector::Max(t1, t2);
 
 			if (hit_point != Start)
 			{
-				Progress(current_cell, t_max);
+				Progress(current_cell, t_max, delta);
 			}
 
-			const int32 max_steps = CalculateMaxSteps(hit_point);
+			const int32 max_steps = CalculateMaxSteps(hit_point, grid.CellSize());
+			TOversizedVisits<Semantics> visits;
 			
 			for (int32 step = 0; step < max_steps; ++step)
 			{
-				CheckAll(grid, current_cell, checked_cells, std::forward<IterFunc>(func));
+				CheckAll(grid, current_cell, checked_cells, visits, std::forward<IterFunc>(func));
 
 				if (current_cell == end_cell || !grid.IsCellWithinBounds(current_cell))
 				{
 					break;
 				}
 
-				Progress(current_cell, t_max);
+				Progress(current_cell, t_max, delta);
 			}
 		}
 		
+		/// This function is not thread safe!!!
+		/// Lazy range over the same hits as Multi, see TLineTraceView.
+		TLineTraceView<Semantics> View(const Grid& grid) const
+		{
+			return TLineTraceView<Semantics>(grid, *this);
+		}
+		
 		QueryResult Single(const Grid& grid) const
 		{
 			QueryResult result = {};
@@ -92,29 +98,34 @@ namespace SpatialGrid
 			CellSet   checked_cells(100);
 			CellIndex current_cell = grid.LocationToCoordinates(hit_point);
 			const FVector start_cell_origin = grid.CellCenter(current_cell);
+			const FVector cell_extent = SpatialGrid::CellExtent<Semantics>(grid.CellSize());
 			const FVector t1 = ((start_cell_origin - cell_extent) - hit_point) * InvDir;
 			const FVector t2 = ((start_cell_origin + cell_extent) - hit_point) * InvDir;
 			const CellIndex end_cell = grid.LocationToCoordinates(End);
+			const FVector delta = CellDelta(grid);
 
 			FVector t_max = FVector::Max(t1, t2);
 
 			if (hit_point != Start)
 			{
-				Progress(current_cell, t_max);
+				Progress(current_cell, t_max, delta);
 			}
 
-			const int32 max_steps = CalculateMaxSteps(hit_point);
+			const int32 max_steps = CalculateMaxSteps(hit_point, grid.CellSize());
+			TOversizedVisits<Semantics> visits;
+			result.Location = End;
 			
 			for(int32 steps = 0; steps < max_steps; ++steps) 
 			{
-				CheckClosest(grid, current_cell, checked_cells, result);
+				CheckClosest(grid, current_cell, checked_cells, visits, result);
 
-				if (result.BlockingHit || current_cell == end_cell || !grid.IsCellWithinBounds(current_cell))
+				// Hits past the current path cell can still lose against elements around the next path cells.
+				if ((result.BlockingHit && ((result.ImpactPoint - hit_point) | Dir) <= CellExit(t_max)) || current_cell == end_cell || !grid.IsCellWithinBounds(current_cell))
 				{
 					break;
 				}
 
-				Progress(current_cell, t_max);
+				Progress(current_cell, t_max, delta);
 			}
 	
 			return result;
@@ -125,42 +136,78 @@ namespace SpatialGrid
 		FVector End;
 		FVector Dir;
 		FVector InvDir;
-		FVector Delta;
 		CellIndex Step;
-		static constexpr FVector cell_extent = SpatialGrid::CellExtent<Semantics>();
 
-		int32 CalculateMaxSteps(const FVector& hit_point) const
+		friend struct TLineTraceView<Semantics>;
+
+		/// Elements stick out of their cell by up to MaxElementRadius, the line has to pass the grown cell bounds.
+		bool MayHitCell(const Cell& cell) const
+		{
+			return LineIntersectsBox(cell.GetBounds().ExpandBy(Semantics::MaxElementRadius), Start, InvDir);
+		}
+
+		/// Distance along the line from the grid entry to where it leaves the current path cell, `t_max` as kept by Progress.
+		static double CellExit(const FVector& t_max)
+		{
+			return IsPlanar<Semantics>() ? FMath::Min(t_max.X, t_max.Y) : t_max.GetMin();
+		}
+
+		/// Distance along the line between two crossings of a cell boundary, per axis.
+		FVector CellDelta(const Grid& grid) const
+		{
+			return InvDir.GetAbs() * grid.CellSize();
+		}
+
+		int32 CalculateMaxSteps(const FVector& hit_point, const double cell_size) const
 		{
 			const FVector delta = End - hit_point;
 			
+			// Planar grids walk a 2D line across columns, the height never changes the cell.
+			const int32 z_steps = IsPlanar<Semantics>() ? 0 : FMath::CeilToInt(FMath::Abs(delta.Z) / cell_size);
+
 			return
-			FMath::CeilToInt(FMath::Abs(delta.X) / Semantics::CellSize) + 
-			FMath::CeilToInt(FMath::Abs(delta.Y) / Semantics::CellSize) +
-			FMath::CeilToInt(FMath::Abs(delta.Z) / Semantics::CellSize) + 1;	
+			FMath::CeilToInt(FMath::Abs(delta.X) / cell_size) + 
+			FMath::CeilToInt(FMath::Abs(delta.Y) / cell_size) +
+			z_steps + 1;	
 		}
 		
-		void Progress(CellIndex& current_cell, FVector& t_max) const
+		void Progress(CellIndex& current_cell, FVector& t_max, const FVector& delta) const
 		{
+			if constexpr (IsPlanar<Semantics>())
+			{
+				if (t_max.X < t_max.Y)
+				{
+					current_cell.X += Step.X;
+					t_max.X += delta.X;
+				}
+				else
+				{
+					current_cell.Y += Step.Y;
+					t_max.Y += delta.Y;
+				}
+				return;
+			}
+
 			// Determine which axis is crossed next
 			if (t_max.X < t_max.Y && t_max.X < t_max.Z)
 			{
 				current_cell.X += Step.X;
-				t_max.X += Delta.X;
+				t_max.X += delta.X;
 			}
 			else if (t_max.Y < t_max.Z)
 			{
 				current_cell.Y += Step.Y;
-				t_max.Y += Delta.Y;
+				t_max.Y += delta.Y;
 			}
 			else
 			{
 				current_cell.Z += Step.Z;
-				t_max.Z += Delta.Z;
+				t_max.Z += delta.Z;
 			}
 		}
 		
 		template<typename F>
-		void CheckAll(const Grid& grid, const CellIndex& offset, CellSet& checked_cells, F&& func) const
+		void CheckAll(const Grid& grid, const CellIndex& offset, CellSet& checked_cells, TOversizedVisits<Semantics>& visits, F&& func) const
 		{
 			auto scan_element = [this, func = std::forward<F>(func)](const ElementId& id, const Element& element)
 			{
@@ -170,18 +217,18 @@ namespace SpatialGrid
 				}
 			};
 			
-			auto scan_cell = [this, &grid, &scan_element](const Cell& cell)
+			auto scan_cell = [this, &grid, &visits, &scan_element](const Cell& cell)
 			{
-				if (cell.HasElements() && LineIntersectsBox(cell.GetBounds(), Start, InvDir))
+				if (cell.HasElements() && MayHitCell(cell))
 				{
-					cell.ForEachElement(grid, scan_element);
+					cell.ForEachElement(grid, visits, scan_element);
 				}
 			};
 			
-			// check (3x3x3) cube around current cell (including current cell)
-			CellRange(1).ForEach([&](const CellIndex& index)
+			// check (3x3x3) cube around current cell (including current cell), (3x3) on planar grids
+			NeighbourRange<Semantics>(1).ForEach(offset, [&](const CellIndex& coords)
 			{
-				if(const CellIndex coords = index + offset; !checked_cells.contains(coords))
+				if (!checked_cells.contains(coords))
 				{
 					grid.GetCell(coords, scan_cell);
 					checked_cells.insert(coords);
@@ -189,10 +236,8 @@ namespace SpatialGrid
 			});
 		}
 
-		void CheckClosest(const Grid& grid, const CellIndex& offset, CellSet& checked_cells, QueryResult& closest) const
+		void CheckClosest(const Grid& grid, const CellIndex& offset, CellSet& checked_cells, TOversizedVisits<Semantics>& visits, QueryResult& closest) const
 		{
-			closest.Location = End;
-			
 			auto scan_element = [this, &closest](const ElementId id, const Element& element)
 			{
 				if (FVector hit_loc; element.Bounds.LineHitPoint(Start, End, Dir, InvDir, hit_loc))
@@ -206,18 +251,18 @@ namespace SpatialGrid
 				}
 			};
 			
-			auto scan_cell = [this, &grid, &scan_element](const Cell& cell)
+			auto scan_cell = [this, &grid, &visits, &scan_element](const Cell& cell)
 			{
-				if (cell.HasElements() && LineIntersectsBox(cell.GetBounds(), Start, InvDir))
+				if (cell.HasElements() && MayHitCell(cell))
 				{
-					cell.ForEachElement(grid, scan_element);
+					cell.ForEachElement(grid, visits, scan_element);
 				}
 			};
 			
-			// check (3x3x3) cube around current cell (including current cell)
-			CellRange(1).ForEach(offset, [&](const CellIndex index)
+			// check (3x3x3) cube around current cell (including current cell), (3x3) on planar grids
+			NeighbourRange<Semantics>(1).ForEach(offset, [&](const CellIndex& coords)
 			{
-				if(const CellIndex coords = index + offset; !checked_cells.contains(coords))
+				if (!checked_cells.contains(coords))
 				{
 					grid.GetCell(coords, scan_cell);
 					checked_cells.insert(coords);
@@ -225,4 +270,146 @@ namespace SpatialGrid
 			});
 		}
 	};
+
+	/**
+	 * Lazy range over the elements hit by a line trace, in the same order as TLineTrace::Multi.
+	 * Instead of a set of checked cells the view remembers the last path cells, the walk only ever steps forward on
+	 * every axis so a neighbour cell checked earlier is always within one cell of one of the last six path cells.
+	 * Views can be resumed with another begin() as long as the grid did not change in between.
+	 */
+	template<typename Semantics>
+	struct TLineTraceView
+	{
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using Element	= typename Grid::Element;
+		using TraceType	= TLineTrace<Semantics>;
+		using ValueType	= TTraceEntry<Element>;
+
+		TLineTraceView(const Grid& grid, const TraceType& trace) : GridPtr(&grid), Trace(trace)
+		{
+			FVector hit_point;
+			if (!LineBoxHitPoint(grid.GetBounds(), Trace.Start, Trace.End, Trace.Dir, Trace.InvDir, hit_point))
+			{
+				return;
+			}
+
+			PathCell = grid.LocationToCoordinates(hit_point);
+			EndCell = grid.LocationToCoordinates(Trace.End);
+
+			const FVector start_cell_origin = grid.CellCenter(PathCell);
+			const FVector cell_extent = SpatialGrid::CellExtent<Semantics>(grid.CellSize());
+			const FVector t1 = ((start_cell_origin - cell_extent) - hit_point) * Trace.InvDir;
+			const FVector t2 = ((start_cell_origin + cell_extent) - hit_point) * Trace.InvDir;
+			TMax = FVector::Max(t1, t2);
+			Delta = Trace.CellDelta(grid);
+
+			if (hit_point != Trace.Start)
+			{
+				Trace.Progress(PathCell, TMax, Delta);
+			}
+
+			MaxSteps = Trace.CalculateMaxSteps(hit_point, grid.CellSize());
+			Advance();
+		}
+
+		TCursorIterator<TLineTraceView> begin() { return TCursorIterator<TLineTraceView>(this); }
+		std::default_sentinel_t end() const { return std::default_sentinel; }
+
+		const ValueType& Current() const { return Entry; }
+		bool IsDone() const { return CurrentCell == nullptr; }
+
+		void Advance()
+		{
+			while (CurrentCell || NextCell())
+			{
+				for (ElementId id = CurrentCell->NextElement(*GridPtr, Visits, ElementIndex); id != ElementId();
+					id = CurrentCell->NextElement(*GridPtr, Visits, ElementIndex))
+				{
+					const Element* element = GridPtr->GetElement(id);
+
+					if (FVector hit_loc; element && element->Bounds.LineHitPoint(Trace.Start, Trace.End, Trace.Dir, Trace.InvDir, hit_loc))
+					{
+						Entry = ValueType{ id, element, hit_loc };
+						return;
+					}
+				}
+
+				CurrentCell = nullptr;
+			}
+		}
+
+	private:
+		static constexpr int32 PathHistory = 6;
+		static constexpr int32 NumNeighbours = IsPlanar<Semantics>() ? 9 : 27;
+
+		const Grid* GridPtr = nullptr;
+		TraceType Trace;
+		CellIndex PathCell;
+		CellIndex EndCell;
+		FVector TMax;
+		FVector Delta;
+		int32 Step = 0;
+		int32 MaxSteps = 0;
+		int32 Neighbour = 0;
+		CellIndex RecentPath[PathHistory];
+		int32 NumRecent = 0;
+		const Cell* CurrentCell = nullptr;
+		int32 ElementIndex = 0;
+		TOversizedVisits<Semantics> Visits;
+		ValueType Entry;
+
+		/// Moves to the next unchecked cell of the (3x3x3) cube, or (3x3) square on planar grids, around the path the
+		/// line passes through.
+		bool NextCell()
+		{
+			while (Step < MaxSteps)
+			{
+				while (Neighbour < NumNeighbours)
+				{
+					const CellIndex coords = NeighbourRange<Semantics>(1).Get(Neighbour, PathCell);
+					++Neighbour;
+
+					if (WasChecked(coords))
+					{
+						continue;
+					}
+
+					const Cell* cell = GridPtr->GetCell(coords);
+					if (cell && cell->HasElements() && Trace.MayHitCell(*cell))
+					{
+						CurrentCell = cell;
+						ElementIndex = 0;
+						return true;
+					}
+				}
+
+				if (++Step >= MaxSteps || PathCell == EndCell || !GridPtr->IsCellWithinBounds(PathCell))
+				{
+					Step = MaxSteps;
+					break;
+				}
+
+				RecentPath[NumRecent++ % PathHistory] = PathCell;
+				Trace.Progress(PathCell, TMax, Delta);
+				Neighbour = 0;
+			}
+
+			return false;
+		}
+
+		bool WasChecked(const CellIndex& coords) const
+		{
+			for (int32 i = 0; i < FMath::Min(NumRecent, PathHistory); ++i)
+			{
+				const CellIndex delta = coords - RecentPath[i];
+				if (FMath::Abs(delta.X) <= 1 && FMath::Abs(delta.Y) <= 1 && FMath::Abs(delta.Z) <= 1)
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+	};
 }
\ No newline at end of file
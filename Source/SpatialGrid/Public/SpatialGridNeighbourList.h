@@ -0,0 +1,173 @@
+﻿#pragma once
+
+#include "Grid.h"
+#include "SpatialGridPairs.h"
+
+namespace SpatialGrid
+{
+	/**
+	 * Verlet neighbour list: per-element candidates within Radius + Skin, built from the grid by a pair broadphase.
+	 * Element moves are followed through the grid change feed (requires Semantics::TrackChanges), the lists are
+	 * rebuilt only once an element moved more than Skin / 2 since the last build or elements were added or removed.
+	 * Between rebuilds neighbour lookups are a contiguous scan over the candidate list without touching the grid.
+	 */
+	template<typename Semantics>
+	struct TNeighbourList
+	{
+		static_assert(TracksChanges<Semantics>(), "neighbour lists require Semantics::TrackChanges");
+
+		using Grid		= TSpatialGrid<Semantics>;
+		using Element	= typename Grid::Element;
+
+		TNeighbourList(const double radius, const double skin) : Radius(radius), Skin(skin) {}
+
+		/// This function is not thread safe!!!
+		/// Catches up with the grid change feed and rebuilds if needed, returns true when the lists were rebuilt.
+		bool Update(const Grid& grid)
+		{
+			bool rebuild = !bBuilt || !grid.CanReplayChangesSince(ChangeCursor);
+
+			if (!rebuild)
+			{
+				const double max_displacement_sq = FMath::Square(Skin * 0.5);
+
+				grid.ForEachChangeSince(ChangeCursor, [&](const ElementChange& change)
+				{
+					if (rebuild)
+					{
+						return;
+					}
+
+					const auto it = LocalIndices.find(change.Id);
+					const Element* element = grid.GetElement(change.Id);
+
+					if (change.Type != EElementChange::Moved || it == LocalIndices.end() || !element)
+					{
+						rebuild = true;
+						return;
+					}
+
+					const int32 local = it->second;
+					Positions[local] = element->Bounds.Origin;
+					rebuild = FVector::DistSquared(Positions[local], BuildPositions[local]) > max_displacement_sq;
+				});
+			}
+
+			if (rebuild)
+			{
+				Build(grid);
+			}
+
+			ChangeCursor = grid.ChangeSequence();
+			return rebuild;
+		}
+
+		/// This function is not thread safe!!!
+		void Build(const Grid& grid)
+		{
+			Ids.Reset();
+			Positions.Reset();
+			LocalIndices.clear();
+
+			grid.ForEachElement([this](const ElementId id, const Element& element)
+			{
+				LocalIndices.emplace(id, Ids.Num());
+				Ids.Add(id);
+				Positions.Add(element.Bounds.Origin);
+			});
+
+			BuildPositions = Positions;
+
+			// Count candidates per element first so the lists end up in one contiguous array.
+			TArray<TPair<int32, int32>> pairs;
+			Offsets.Init(0, Ids.Num() + 1);
+
+			TPairQuery<Semantics>(Radius + Skin).Each(grid, [&](const ElementId a, const Element&, const ElementId b, const Element&)
+			{
+				const int32 local_a = LocalIndices.at(a);
+				const int32 local_b = LocalIndices.at(b);
+				pairs.Emplace(local_a, local_b);
+				++Offsets[local_a + 1];
+				++Offsets[local_b + 1];
+			});
+
+			for (int32 i = 1; i < Offsets.Num(); ++i)
+			{
+				Offsets[i] += Offsets[i - 1];
+			}
+
+			TArray<int32> cursor(Offsets);
+			Neighbours.SetNumUninitialized(pairs.Num() * 2);
+
+			for (const TPair<int32, int32>& pair : pairs)
+			{
+				Neighbours[cursor[pair.Key]++] = pair.Value;
+				Neighbours[cursor[pair.Value]++] = pair.Key;
+			}
+
+			ChangeCursor = grid.ChangeSequence();
+			bBuilt = true;
+		}
+
+		/// Calls func(neighbour_id, neighbour_location) for every element whose origin is within Radius of `id`.
+		template<typename F>
+		void ForEachNeighbour(const ElementId& id, F&& func) const
+		{
+			if (const auto it = LocalIndices.find(id); it != LocalIndices.end())
+			{
+				ForEachNeighbourAt(it->second, std::forward<F>(func));
+			}
+		}
+
+		/// Same as ForEachNeighbour but addressed by the local index handed out by ForEachElement.
+		template<typename F>
+		void ForEachNeighbourAt(const int32 local, F&& func) const
+		{
+			const FVector& origin = Positions[local];
+			const double radius_sq = Radius * Radius;
+
+			for (int32 i = Offsets[local]; i < Offsets[local + 1]; ++i)
+			{
+				const int32 other = Neighbours[i];
+
+				if (FVector::DistSquared(origin, Positions[other]) <= radius_sq)
+				{
+					func(Ids[other], Positions[other]);
+				}
+			}
+		}
+
+		/// Calls func(local_index, id, location) for every element the lists were built for.
+		template<typename F>
+		void ForEachElement(F&& func) const
+		{
+			for (int32 i = 0; i < Ids.Num(); ++i)
+			{
+				func(i, Ids[i], Positions[i]);
+			}
+		}
+
+		int32 Num() const { return Ids.Num(); }
+
+		int32 NumCandidates() const { return Neighbours.Num(); }
+
+		/// Grid change sequence the next update replays from, changes before it can be trimmed, see TSpatialGrid::TrimChanges.
+		uint64 GetChangeCursor() const { return ChangeCursor; }
+
+	private:
+		double Radius = 0;
+		double Skin = 0;
+		bool bBuilt = false;
+		uint64 ChangeCursor = 0;
+
+		TArray<ElementId> Ids;
+		/// Latest known locations, refreshed from the change feed.
+		TArray<FVector> Positions;
+		/// Locations at the last build, displacement is measured against these.
+		TArray<FVector> BuildPositions;
+		/// Candidates of local element i are Neighbours[Offsets[i], Offsets[i + 1]).
+		TArray<int32> Offsets;
+		TArray<int32> Neighbours;
+		ankerl::unordered_dense::map<ElementId, int32> LocalIndices;
+	};
+}
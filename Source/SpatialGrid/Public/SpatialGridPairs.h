@@ -0,0 +1,317 @@
+﻿#pragma once
+
+#include "Async/ParallelFor.h"
+#include "Grid.h"
+#include "SpatialGridUtils.h"
+
+namespace SpatialGrid
+{
+	/// Broadphase over occupied cells, visits every unordered pair of elements whose origins are within `Distance`.
+	template<typename Semantics>
+	struct TPairQuery
+	{
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using Element	= typename Grid::Element;
+
+		/// Ids of the pairs found by one worker.
+		using PairBuffer = TArray<TPair<ElementId, ElementId>>;
+
+		explicit TPairQuery(const double distance) : Distance(distance) {}
+
+		/// This function is not thread safe!!!
+		/// Calls func(id_a, element_a, id_b, element_b) once per pair.
+		template<typename F>
+		void Each(const Grid& grid, F&& func) const
+		{
+			const TArray<CellIndex> neighbours = HalfStencil(grid.CellSize());
+			const double distance_sq = Distance * Distance;
+
+			TArray<Candidate> own;
+			TArray<Candidate> other;
+
+			grid.ForEachCell([&](const CellIndex& coords, const Cell& cell)
+			{
+				if (!cell.HasElements())
+				{
+					return;
+				}
+
+				Gather(grid, cell, own);
+
+				for (int32 i = 0; i < own.Num(); ++i)
+				{
+					for (int32 j = i + 1; j < own.Num(); ++j)
+					{
+						Test(own[i], own[j], distance_sq, func);
+					}
+				}
+
+				for (const CellIndex& offset : neighbours)
+				{
+					const Cell* neighbour = grid.GetCell(coords + offset);
+					if (!neighbour || !neighbour->HasElements())
+					{
+						continue;
+					}
+
+					Gather(grid, *neighbour, other);
+
+					for (const Candidate& a : own)
+					{
+						for (const Candidate& b : other)
+						{
+							Test(a, b, distance_sq, func);
+						}
+					}
+				}
+			});
+		}
+
+		/**
+		 * This function is not thread safe!!!
+		 * Parallel version of Each, func(context, id_a, element_a, id_b, element_b) runs on the task graph with one
+		 * default constructed Context per worker, then reduce(context) is called for every context on this thread.
+		 * Work is split into cell pairs, rows of cell pairs too expensive for one task are split off while runs of
+		 * cheap cell pairs are batched into one item, so every item costs about MaxItemCost. Items are handed out
+		 * most expensive first so crowded cells start early and idle workers pick up the cheap items behind them.
+		 */
+		template<typename Context, typename F, typename ReduceFunc>
+		void ParallelEachWithContext(const Grid& grid, F&& func, ReduceFunc&& reduce) const
+		{
+			const double distance_sq = Distance * Distance;
+
+			// Copy candidates of every occupied cell into one array so work items are plain index ranges.
+			TArray<CellSpan> spans;
+			ankerl::unordered_dense::map<CellIndex, int32> span_lookup;
+			int32 num_candidates = 0;
+
+			grid.ForEachCell([&](const CellIndex& coords, const Cell& cell)
+			{
+				if (cell.HasElements())
+				{
+					span_lookup.emplace(coords, spans.Num());
+					spans.Add(CellSpan{ coords, &cell, num_candidates, cell.NumElements() });
+					num_candidates += cell.NumElements();
+				}
+			});
+
+			TArray<Candidate> candidates;
+			candidates.SetNumUninitialized(num_candidates);
+
+			ParallelFor(TEXT("SpatialGrid.PairGather"), spans.Num(), 64, [&](const int32 index)
+			{
+				const CellSpan& span = spans[index];
+				for (int32 i = 0; i < span.Num; ++i)
+				{
+					const ElementId id = span.Source->GetElementAt(i);
+					candidates[span.Begin + i] = Candidate{ id, grid.GetElement(id) };
+				}
+			});
+
+			TArray<WorkPiece> pieces;
+			const TArray<WorkItem> items = MakeWorkItems(grid, spans, span_lookup, pieces);
+
+			TArray<Context> contexts;
+			ParallelForWithTaskContext(TEXT("SpatialGrid.PairQuery"), contexts, items.Num(), 1, [&](Context& context, const int32 index)
+			{
+				auto visit = [&](const ElementId id_a, const Element& element_a, const ElementId id_b, const Element& element_b)
+				{
+					func(context, id_a, element_a, id_b, element_b);
+				};
+
+				const WorkItem& item = items[index];
+
+				for (int32 p = item.Begin; p < item.Begin + item.Num; ++p)
+				{
+					const WorkPiece& piece = pieces[p];
+					const CellSpan& a = spans[piece.A];
+					const CellSpan& b = spans[piece.B];
+
+					for (int32 i = a.Begin + piece.RowBegin; i < a.Begin + piece.RowEnd; ++i)
+					{
+						for (int32 j = piece.A == piece.B ? i + 1 : b.Begin; j < b.Begin + b.Num; ++j)
+						{
+							Test(candidates[i], candidates[j], distance_sq, visit);
+						}
+					}
+				}
+			}, EParallelForFlags::Unbalanced);
+
+			for (Context& context : contexts)
+			{
+				reduce(context);
+			}
+		}
+
+		/// This function is not thread safe!!!
+		/// Collects every pair into one buffer per worker, consume them in place or append them to one array.
+		void ParallelCollect(const Grid& grid, TArray<PairBuffer>& out_buffers) const
+		{
+			out_buffers.Reset();
+
+			ParallelEachWithContext<PairBuffer>(grid,
+				[](PairBuffer& buffer, const ElementId id_a, const Element&, const ElementId id_b, const Element&)
+				{
+					buffer.Emplace(id_a, id_b);
+				},
+				[&out_buffers](PairBuffer& buffer)
+				{
+					if (!buffer.IsEmpty())
+					{
+						out_buffers.Add(MoveTemp(buffer));
+					}
+				});
+		}
+
+		/// Forward half of the neighbour cells that can hold a pair within `Distance`, every cell pair is visited once.
+		TArray<CellIndex> HalfStencil(const double cell_size) const
+		{
+			const int32 range = FMath::FloorToInt32(Distance / cell_size) + 1;
+			const double distance_sq = FMath::Square(Distance / cell_size);
+
+			TArray<CellIndex> offsets;
+
+			NeighbourRange<Semantics>(range).ForEach([&](const CellIndex& offset)
+			{
+				const bool forward = offset.Z > 0 || (offset.Z == 0 && (offset.Y > 0 || (offset.Y == 0 && offset.X > 0)));
+				if (!forward)
+				{
+					return;
+				}
+
+				// Closest distance between origins stored in the two cells, in cell units.
+				const double gap_sq =
+					FMath::Square(FMath::Max(FMath::Abs(offset.X) - 1, 0)) +
+					FMath::Square(FMath::Max(FMath::Abs(offset.Y) - 1, 0)) +
+					FMath::Square(FMath::Max(FMath::Abs(offset.Z) - 1, 0));
+
+				if (gap_sq <= distance_sq)
+				{
+					offsets.Add(offset);
+				}
+			});
+
+			return offsets;
+		}
+
+	private:
+		struct Candidate
+		{
+			ElementId Id;
+			const Element* Entry;
+		};
+
+		/// Candidates of one occupied cell in the flattened candidate array.
+		struct CellSpan
+		{
+			CellIndex Coords;
+			const Cell* Source;
+			int32 Begin;
+			int32 Num;
+		};
+
+		/// Rows [RowBegin, RowEnd) of span A tested against span B, or against the rest of A if A == B.
+		struct WorkPiece
+		{
+			int32 A;
+			int32 B;
+			int32 RowBegin;
+			int32 RowEnd;
+		};
+
+		/// Consecutive pieces [Begin, Begin + Num) one task runs.
+		struct WorkItem
+		{
+			int32 Begin;
+			int32 Num;
+			int64 Cost;
+		};
+
+		/// Element tests one task should take at most, larger cell pairs are split by rows and smaller ones batched.
+		static constexpr int64 MaxItemCost = 4096;
+
+		double Distance = 0;
+
+		/// Pieces are appended in cell order, an item stays open across cell pairs until it reaches MaxItemCost.
+		TArray<WorkItem> MakeWorkItems(const Grid& grid, const TArray<CellSpan>& spans,
+			const ankerl::unordered_dense::map<CellIndex, int32>& span_lookup, TArray<WorkPiece>& out_pieces) const
+		{
+			const TArray<CellIndex> neighbours = HalfStencil(grid.CellSize());
+			TArray<WorkItem> items;
+			WorkItem open = { 0, 0, 0 };
+
+			auto close_item = [&items, &open, &out_pieces]()
+			{
+				if (open.Num > 0)
+				{
+					items.Add(open);
+				}
+				open = WorkItem{ out_pieces.Num(), 0, 0 };
+			};
+
+			auto add_rows = [&out_pieces, &open, &close_item](const int32 a, const int32 b, const int32 rows, auto&& row_cost)
+			{
+				int32 begin = 0;
+
+				for (int32 row = 0; row < rows; ++row)
+				{
+					open.Cost += row_cost(row);
+
+					if (open.Cost >= MaxItemCost || row == rows - 1)
+					{
+						out_pieces.Add(WorkPiece{ a, b, begin, row + 1 });
+						open.Num += 1;
+						begin = row + 1;
+
+						if (open.Cost >= MaxItemCost)
+						{
+							close_item();
+						}
+					}
+				}
+			};
+
+			for (int32 a = 0; a < spans.Num(); ++a)
+			{
+				const int32 num_a = spans[a].Num;
+
+				if (num_a > 1)
+				{
+					add_rows(a, a, num_a - 1, [num_a](const int32 row) { return int64(num_a - row - 1); });
+				}
+
+				for (const CellIndex& offset : neighbours)
+				{
+					if (const auto it = span_lookup.find(spans[a].Coords + offset); it != span_lookup.end())
+					{
+						const int32 num_b = spans[it->second].Num;
+						add_rows(a, it->second, num_a, [num_b](const int32) { return int64(num_b); });
+					}
+				}
+			}
+
+			close_item();
+			items.Sort([](const WorkItem& lhs, const WorkItem& rhs) { return lhs.Cost > rhs.Cost; });
+			return items;
+		}
+
+		static void Gather(const Grid& grid, const Cell& cell, TArray<Candidate>& out)
+		{
+			out.Reset();
+			cell.ForEachElement(grid, [&out](const ElementId id, const Element& element)
+			{
+				out.Add(Candidate{ id, &element });
+			});
+		}
+
+		template<typename F>
+		static void Test(const Candidate& a, const Candidate& b, const double distance_sq, F& func)
+		{
+			if (FVector::DistSquared(a.Entry->Bounds.Origin, b.Entry->Bounds.Origin) <= distance_sq)
+			{
+				func(a.Id, *a.Entry, b.Id, *b.Entry);
+			}
+		}
+	};
+}
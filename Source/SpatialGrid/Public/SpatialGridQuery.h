@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Grid.h"
+#include "SpatialGridCollectors.h"
+#include "SpatialGridRange.h"
 #include "SpatialGridUtils.h"
 
 namespace SpatialGrid
@@ -16,6 +18,172 @@ namespace SpatialGrid
 
 	template<typename GridSemantics>
 	struct TSphereQueryBuilder;
+
+	template<typename Semantics, EQueryCacheType>
+	struct TSphereQueryView;
+	
+	struct SphereShape
+	{
+		FVector Origin;
+		double Radius;
+
+		bool OverlapsCell(const FBox& cell_bounds, const double reach) const
+		{
+			return BoxIntersectsSphere(cell_bounds, Origin, Radius + reach);
+		}
+
+		bool Overlaps(const Bounds& bounds) const
+		{
+			return bounds.OverlapsSphere(Origin, Radius);
+		}
+
+		/// True if every element stored in the cell overlaps the shape.
+		bool ContainsCell(const FBox& cell_bounds) const
+		{
+			return BoxFarthestDistanceSquared(cell_bounds, Origin) <= Radius * Radius;
+		}
+	};
+
+	/// Sphere with a hole, elements lying completely inside MinRadius are rejected.
+	struct AnnulusShape
+	{
+		FVector Origin;
+		double Radius;
+		double MinRadius;
+
+		bool OverlapsCell(const FBox& cell_bounds, const double reach) const
+		{
+			return BoxIntersectsSphere(cell_bounds, Origin, Radius + reach)
+				&& BoxFarthestDistanceSquared(cell_bounds, Origin) >= FMath::Square(FMath::Max(MinRadius - reach, 0.));
+		}
+
+		bool Overlaps(const Bounds& bounds) const
+		{
+			return bounds.OverlapsSphere(Origin, Radius) && !bounds.InsideSphere(Origin, MinRadius);
+		}
+
+		bool ContainsCell(const FBox& cell_bounds) const
+		{
+			return BoxFarthestDistanceSquared(cell_bounds, Origin) <= Radius * Radius
+				&& FVector::DistSquared(Origin, cell_bounds.GetClosestPointTo(Origin)) >= MinRadius * MinRadius;
+		}
+	};
+
+	struct CapsuleShape
+	{
+		FVector Start;
+		FVector End;
+		double Radius;
+
+		bool OverlapsCell(const FBox& cell_bounds, const double reach) const
+		{
+			return SegmentBoxDistanceSquared(Start, End, cell_bounds) <= FMath::Square(Radius + reach);
+		}
+
+		bool Overlaps(const Bounds& bounds) const
+		{
+			return bounds.OverlapsCapsule(Start, End, Radius);
+		}
+	};
+
+	/// How a query stencil treats a cell, Inner cells only hold overlapping elements, Edge cells need the element
+	/// tests and Outer cells may not reach the shape at all.
+	enum class ECellStage : uint8
+	{
+		Inner,
+		Edge,
+		Outer,
+	};
+
+	/// Cell and element stages shared by the shape queries, a shape provides OverlapsCell and Overlaps.
+	template<typename Semantics>
+	struct TQueryStages
+	{
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using Element	= typename Grid::Element;
+		using Visits	= TOversizedVisits<Semantics>;
+
+		/// Reports the elements of `cell` overlapping the shape, oversized elements only once per `visits`.
+		template<typename Shape, typename F>
+		static void ScanElements(const Grid& grid, const Cell& cell, const Shape& shape, Visits& visits, F& func)
+		{
+			cell.ForEachElement(grid, visits, [&](const ElementId id, const Element& element)
+			{
+				if (shape.Overlaps(element.Bounds))
+				{
+					func(id, element);
+				}
+			});
+		}
+
+		/// Skips cells no element of which can reach the shape, then runs the element stage.
+		template<typename Shape, typename F>
+		static void ScanCell(const Grid& grid, const Cell& cell, const Shape& shape, Visits& visits, F& func)
+		{
+			if (cell.HasElements() && shape.OverlapsCell(cell.GetBounds(), Semantics::MaxElementRadius))
+			{
+				ScanElements(grid, cell, shape, visits, func);
+			}
+		}
+
+		/// Runs the stage the stencil assigned to `cell`. Oversized elements are only listed by cells they overlap,
+		/// so inner cells hand them out untested as well.
+		template<typename Shape, typename F>
+		static void ScanCell(const Grid& grid, const Cell& cell, const Shape& shape, const ECellStage stage, Visits& visits, F& func)
+		{
+			switch (stage)
+			{
+			case ECellStage::Inner: return cell.ForEachElement(grid, visits, func);
+			case ECellStage::Edge: return ScanElements(grid, cell, shape, visits, func);
+			case ECellStage::Outer: return ScanCell(grid, cell, shape, visits, func);
+			}
+		}
+
+		/// Collector version of ScanCell, returns false once the collector is full.
+		/// Count-only collectors take inner cells as a whole and never touch their elements, unless oversized
+		/// elements overlap the cell, those may be listed by several cells.
+		template<typename Shape, typename Collector>
+		static bool CollectCell(const Grid& grid, const Cell& cell, const Shape& shape, const ECellStage stage, Visits& visits, Collector& collector)
+		{
+			if (!cell.HasElements())
+			{
+				return true;
+			}
+
+			if (stage == ECellStage::Outer && !shape.OverlapsCell(cell.GetBounds(), Semantics::MaxElementRadius))
+			{
+				return true;
+			}
+
+			if constexpr (CountsOnly<Collector>())
+			{
+				if (stage == ECellStage::Inner && !cell.HasOversized())
+				{
+					collector.AddCount(cell.NumElements());
+					return !collector.IsFull();
+				}
+			}
+
+			int32 cursor = 0;
+			for (ElementId id = cell.NextElement(grid, visits, cursor); id != ElementId(); id = cell.NextElement(grid, visits, cursor))
+			{
+				const Element& element = *grid.GetElement(id);
+
+				if (stage == ECellStage::Inner || shape.Overlaps(element.Bounds))
+				{
+					collector.Add(id, element);
+
+					if (collector.IsFull())
+					{
+						return false;
+					}
+				}
+			}
+
+			return true;
+		}
+	};
 	
 	template<typename Semantics, EQueryCacheType CacheType>
 	struct TQueryIter
@@ -24,6 +192,7 @@ namespace SpatialGrid
 		using Cell		= typename Grid::Cell;
 		using Element	= typename Grid::Element;
 		using QueryType	= TSphereQuery<Semantics, CacheType>;
+		using Stages	= TQueryStages<Semantics>;
 
 		TQueryIter(const QueryType* query, const FVector& origin) : Query(query), Origin(origin) {}
 
@@ -31,112 +200,180 @@ namespace SpatialGrid
 		void Each(const Grid& grid, F&& func) const
 		{
 			if (!Query) return;
-			
-			if constexpr(CacheType == EQueryCacheType::Cached)
-			{
-				CachedEach(grid, std::forward<F>(func));
-			}
-			else
+
+			TOversizedVisits<Semantics> visits;
+
+			WithShape([&](const auto& shape)
 			{
-				UncachedEach(grid, std::forward<F>(func));
-			}
+				VisitCells(grid, [&](const Cell& cell, const ECellStage stage)
+				{
+					Stages::ScanCell(grid, cell, shape, stage, visits, func);
+					return true;
+				});
+			});
 		}
 
-	private:
-		const QueryType* Query = nullptr;
-		FVector Origin = FVector::ZeroVector;
-		
-		template<typename F>
-		void CachedEach(const Grid& grid, F&& func) const
+		/// This function is not thread safe!!!
+		/// Feeds the elements overlapping the sphere to `collector` and stops as soon as it is full,
+		/// see SpatialGridCollectors.h for the collector protocol.
+		template<typename Collector>
+		void Collect(const Grid& grid, Collector& collector) const
 		{
-			const double radius = Query->Radius;
-			const double radius_sq = radius * radius;
-			const CellIndex offset = grid.LocationToCoordinates(Origin);
+			if (!Query || collector.IsFull()) return;
 
-			auto scan_element = [this, radius, func=std::forward<F>(func)](const ElementId id, const Element& element)
+			TOversizedVisits<Semantics> visits;
+
+			WithShape([&](const auto& shape)
 			{
-				if (element.Bounds.OverlapsSphere(Origin, radius))
+				VisitCells(grid, [&](const Cell& cell, const ECellStage stage)
 				{
-					func(id, element);
-				}
-			};
-			auto scan_cell = [this, &grid, &scan_element, radius_sq](const CellIndex&, const Cell& cell)
+					return Stages::CollectCell(grid, cell, shape, stage, visits, collector);
+				});
+			});
+		}
+
+		/// This function is not thread safe!!!
+		/// Lazy range over the same elements as Each, see TSphereQueryView.
+		TSphereQueryView<Semantics, CacheType> View(const Grid& grid) const
+		{
+			return TSphereQueryView<Semantics, CacheType>(grid, Query, Origin);
+		}
+
+		/// Sums the aggregates of every element overlapping the sphere (requires Semantics::Aggregates),
+		/// cells completely inside are summed as a whole and only edge cells, and cells overlapped by oversized
+		/// elements, visit their elements.
+		TAggregate<Semantics> Aggregate(const Grid& grid) const
+		{
+			static_assert(HasAggregates<Semantics>(), "aggregate queries require Semantics::Aggregates");
+
+			TAggregate<Semantics> result;
+			if (!Query) { return result; }
+
+			TOversizedVisits<Semantics> visits;
+
+			WithShape([&](const auto& shape)
 			{
-				if (BoxIntersectsSphereRadiusSq(cell.GetBounds(), Origin, radius_sq))
+				VisitCells(grid, [&](const Cell& cell, const ECellStage stage)
 				{
-					cell.ForEachElement(grid, scan_element);
-				}	
-			};
-			
-			if (Query->CellCount() > grid.NumCells())
+					if (stage == ECellStage::Inner && !cell.HasOversized())
+					{
+						result += cell.GetAggregate();
+					}
+					else
+					{
+						AggregateCell(grid, cell, shape, visits, result);
+					}
+					return true;
+				});
+			});
+
+			return result;
+		}
+
+	private:
+		const QueryType* Query = nullptr;
+		FVector Origin = FVector::ZeroVector;
+
+		/// Runs `body` with the annulus shape if the query has a min radius, otherwise with the plain sphere.
+		template<typename F>
+		void WithShape(F&& body) const
+		{
+			if (Query->MinRadius > 0.)
 			{
-				grid.ForEachCell(scan_cell);
-				return;
+				body(AnnulusShape{ Origin, Query->Radius, Query->MinRadius });
 			}
-			
-			for (const CellIndex& cell_coord : Query->InnerCells)
+			else
 			{
-				if (const Cell* cell = grid.GetCell(cell_coord + offset); cell && cell->HasElements())
-				{
-					cell->ForEachElement(grid, std::forward<F>(func));
-				}
+				body(SphereShape{ Origin, Query->Radius });
 			}
+		}
+
+		template<typename Shape>
+		void AggregateCell(const Grid& grid, const Cell& cell, const Shape& shape, TOversizedVisits<Semantics>& visits, TAggregate<Semantics>& result) const
+		{
+			const FBox& bounds = cell.GetBounds();
 
-			for (const CellIndex& cell_coord : Query->EdgeCells)
+			// Cell aggregates hold the oversized elements stored in the cell, which other cells may list too.
+			if (!cell.HasOversized() && shape.ContainsCell(bounds))
 			{
-				if (const Cell* cell = grid.GetCell(cell_coord + offset))
-				{
-					cell->ForEachElement(grid, scan_element);
-				}
+				result += cell.GetAggregate();
 			}
-
-			for (const CellIndex& cell_coord : Query->OuterCells)
+			else if (shape.OverlapsCell(bounds, Semantics::MaxElementRadius))
 			{
-				const Cell* cell = grid.GetCell(cell_coord + offset);
-
-				if (cell && BoxIntersectsSphereRadiusSq(cell->GetBounds(), Origin, radius_sq))
+				cell.ForEachElement(grid, visits, [&](const ElementId, const Element& element)
 				{
-					cell->ForEachElement(grid, scan_element);
-				}
+					if (shape.Overlaps(element.Bounds))
+					{
+						result.Add(element.Bounds.Origin, element.Data);
+					}
+				});
 			}
 		}
-
+		
+		/**
+		 * Calls func(cell, stage) for every stored cell the query can reach until func returns false.
+		 * Inner cells lie between the shells and skip the element tests, edge cells on either shell test every
+		 * element and outer cells are culled as a whole first. Cells inside the hole are not part of the stencil.
+		 */
 		template<typename F>
-		void UncachedEach(const Grid& grid, F&& func) const
+		void VisitCells(const Grid& grid, F&& func) const
 		{
-			if (!Query) { return; }
-			
-			const double radius = Query->Radius;
-			const double radius_sq = radius * radius;
-			const CellRange cell_range(FMath::RoundToInt32(radius / Semantics::CellSize) + 1);
 			const CellIndex offset = grid.LocationToCoordinates(Origin);
 
-			auto scan_element = [this, radius, func=std::forward<F>(func)](const ElementId id, const Element& element)
+			auto visit_all = [&]
 			{
-				if (element.Bounds.OverlapsSphere(Origin, radius))
+				for (int32 index = 0; index < grid.NumCells(); ++index)
 				{
-					func(id, element);
+					CellIndex coords;
+					if (!func(grid.GetCellAt(index, coords), ECellStage::Outer))
+					{
+						return;
+					}
 				}
 			};
-			
-			auto scan_cell = [this, &grid, &scan_element, radius_sq](const CellIndex&, const Cell& cell)
+
+			if constexpr(CacheType == EQueryCacheType::Cached)
 			{
-				if (BoxIntersectsSphereRadiusSq(cell.GetBounds(), Origin, radius_sq))
+				if (Query->HasStencilFor(grid))
 				{
-					cell.ForEachElement(grid, scan_element);
-				}	
-			};
-			
+					if (Query->CellCount() > grid.NumCells())
+					{
+						visit_all();
+						return;
+					}
+
+					const TArray<CellIndex>* stencils[] = { &Query->InnerCells, &Query->EdgeCells, &Query->OuterCells };
+					const ECellStage stages[] = { ECellStage::Inner, ECellStage::Edge, ECellStage::Outer };
+
+					for (int32 stage = 0; stage < UE_ARRAY_COUNT(stencils); ++stage)
+					{
+						for (const CellIndex& cell_coord : *stencils[stage])
+						{
+							if (const Cell* cell = grid.GetCell(cell_coord + offset); cell && !func(*cell, stages[stage]))
+							{
+								return;
+							}
+						}
+					}
+					return;
+				}
+			}
+
+			// Uncached queries, and stencils built for another cell size, test every cell in range.
+			const CellRange cell_range = NeighbourRange<Semantics>(FMath::RoundToInt32(Query->Radius / grid.CellSize()) + 1);
+
 			if (cell_range.Count() > grid.NumCells())
 			{
-				grid.ForEachCell(scan_cell);
+				visit_all();
+				return;
 			}
-			else
+
+			for (int32 index = 0; index < cell_range.Count(); ++index)
 			{
-				cell_range.ForEach([&](const CellIndex& cell_coord)
+				if (const Cell* cell = grid.GetCell(cell_range.Get(index, offset)); cell && !func(*cell, ECellStage::Outer))
 				{
-					grid.GetCell(cell_coord + offset, scan_cell);
-				});
+					return;
+				}
 			}
 		}
 	};
@@ -145,7 +382,7 @@ namespace SpatialGrid
 	struct TSphereQuery
 	{
 		explicit TSphereQuery() = default;
-		explicit TSphereQuery(const double radius) : Radius(radius) {}
+		explicit TSphereQuery(const double radius, const double min_radius = 0.) : Radius(radius), MinRadius(min_radius) {}
 		
 		TQueryIter<Semantics, CacheType> SetOrigin(const FVector& origin) const
 		{
@@ -153,8 +390,10 @@ namespace SpatialGrid
 		}
 	private:
 		double Radius = 0;
+		double MinRadius = 0;
 		
 		friend struct TQueryIter<Semantics, CacheType>;
+		friend struct TSphereQueryView<Semantics, CacheType>;
 		friend struct TSphereQueryBuilder<Semantics>;
 	};
 
@@ -162,7 +401,7 @@ namespace SpatialGrid
 	struct TSphereQuery<Semantics, EQueryCacheType::Cached>
 	{
 		explicit TSphereQuery() = default;
-		explicit TSphereQuery(const double radius) : Radius(radius) {}
+		explicit TSphereQuery(const double radius, const double min_radius = 0.) : Radius(radius), MinRadius(min_radius) {}
 		
 		TQueryIter<Semantics, EQueryCacheType::Cached> SetOrigin(const FVector& origin) const
 		{
@@ -173,17 +412,188 @@ namespace SpatialGrid
 		{
 			return InnerCells.Num() + EdgeCells.Num() + OuterCells.Num();
 		}
+
+		/// Stencils are in cells of the size they were built for, see TSphereQueryBuilder::SetCellSize.
+		bool HasStencilFor(const TSpatialGrid<Semantics>& grid) const
+		{
+			return !HasRuntimeCellSize<Semantics>() || grid.CellSize() == CellSize;
+		}
 		
 	private:
 		double Radius = 0;
+		double MinRadius = 0;
+		double CellSize = Semantics::CellSize;
 		TArray<CellIndex> InnerCells;
 		TArray<CellIndex> EdgeCells;
 		TArray<CellIndex> OuterCells;
 		
 		friend struct TQueryIter<Semantics, EQueryCacheType::Cached>;
+		friend struct TSphereQueryView<Semantics, EQueryCacheType::Cached>;
 		friend struct TSphereQueryBuilder<Semantics>;
 	};
 	
+	/**
+	 * Lazy range over the elements of a sphere query, visiting cells in the same stages as TQueryIter::Each.
+	 * The whole iteration state is a cell cursor and an element index, so a view can be kept between ticks and
+	 * resumed with another begin(), as long as the grid did not change in between.
+	 */
+	template<typename Semantics, EQueryCacheType CacheType>
+	struct TSphereQueryView
+	{
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using Element	= typename Grid::Element;
+		using QueryType	= TSphereQuery<Semantics, CacheType>;
+		using ValueType	= TElementEntry<Element>;
+
+		TSphereQueryView(const Grid& grid, const QueryType* query, const FVector& origin)
+		: GridPtr(&grid)
+		, Query(query)
+		, Shape{ origin, query ? query->Radius : 0., query ? query->MinRadius : 0. }
+		, Offset(grid.LocationToCoordinates(origin))
+		, Range(NeighbourRange<Semantics>(query ? FMath::RoundToInt32(query->Radius / grid.CellSize()) + 1 : 0))
+		{
+			if (!Query)
+			{
+				return;
+			}
+
+			if constexpr(CacheType == EQueryCacheType::Cached)
+			{
+				UseStencil = Query->HasStencilFor(grid);
+				FullScan = (UseStencil ? Query->CellCount() : Range.Count()) > grid.NumCells();
+			}
+			else
+			{
+				FullScan = Range.Count() > grid.NumCells();
+			}
+
+			Advance();
+		}
+
+		TCursorIterator<TSphereQueryView> begin() { return TCursorIterator<TSphereQueryView>(this); }
+		std::default_sentinel_t end() const { return std::default_sentinel; }
+
+		const ValueType& Current() const { return Entry; }
+		bool IsDone() const { return CurrentCell == nullptr; }
+
+		void Advance()
+		{
+			while (CurrentCell || NextCell())
+			{
+				for (ElementId id = CurrentCell->NextElement(*GridPtr, Visits, ElementIndex); id != ElementId();
+					id = CurrentCell->NextElement(*GridPtr, Visits, ElementIndex))
+				{
+					const Element* element = GridPtr->GetElement(id);
+
+					if (element && (!TestElements || Shape.Overlaps(element->Bounds)))
+					{
+						Entry = ValueType{ id, element };
+						return;
+					}
+				}
+
+				CurrentCell = nullptr;
+			}
+		}
+
+	private:
+		const Grid* GridPtr = nullptr;
+		const QueryType* Query = nullptr;
+		AnnulusShape Shape;
+		CellIndex Offset;
+		CellRange Range;
+		bool FullScan = false;
+		bool UseStencil = false;
+		bool TestElements = false;
+		uint8 Stage = 0;
+		int32 Cursor = 0;
+		const Cell* CurrentCell = nullptr;
+		int32 ElementIndex = 0;
+		TOversizedVisits<Semantics> Visits;
+		ValueType Entry;
+
+		/// Moves to the next cell that can store overlapping elements, false once every cell was visited.
+		bool NextCell()
+		{
+			if (!Query)
+			{
+				return false;
+			}
+
+			if (FullScan)
+			{
+				while (Cursor < GridPtr->NumCells())
+				{
+					CellIndex coords;
+					if (Enter(&GridPtr->GetCellAt(Cursor++, coords), ECellStage::Outer))
+					{
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+			if constexpr(CacheType == EQueryCacheType::Cached)
+			{
+				if (UseStencil)
+				{
+					const TArray<CellIndex>* stencils[] = { &Query->InnerCells, &Query->EdgeCells, &Query->OuterCells };
+
+					for (; Stage < UE_ARRAY_COUNT(stencils); ++Stage, Cursor = 0)
+					{
+						while (Cursor < stencils[Stage]->Num())
+						{
+							if (Enter(GridPtr->GetCell((*stencils[Stage])[Cursor++] + Offset), static_cast<ECellStage>(Stage)))
+							{
+								return true;
+							}
+						}
+					}
+
+					return false;
+				}
+			}
+
+			while (Cursor < Range.Count())
+			{
+				if (Enter(GridPtr->GetCell(Range.Get(Cursor++, Offset)), ECellStage::Outer))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		bool Enter(const Cell* cell, const ECellStage stage)
+		{
+			if (!cell || !cell->HasElements())
+			{
+				return false;
+			}
+
+			if (stage == ECellStage::Outer && !Shape.OverlapsCell(cell->GetBounds(), Semantics::MaxElementRadius))
+			{
+				return false;
+			}
+
+			CurrentCell = cell;
+			ElementIndex = 0;
+			TestElements = stage != ECellStage::Inner;
+			return true;
+		}
+	};
+	
+	/// Count, centroid and payload of the elements overlapping a sphere without building a cached query.
+	template<typename Semantics>
+	TAggregate<Semantics> AggregateSphere(const TSpatialGrid<Semantics>& grid, const FVector& origin, const double radius)
+	{
+		const TSphereQuery<Semantics, EQueryCacheType::UnCached> query(radius);
+		return query.SetOrigin(origin).Aggregate(grid);
+	}
+
 	template<typename Semantics>
 	struct TSphereQueryBuilder
 	{
@@ -194,6 +604,21 @@ namespace SpatialGrid
 			Radius = radius;
 			return *this;
 		}
+
+		/// Rejects elements lying completely inside `min_radius`, cached queries drop the cells of the hole entirely.
+		Self& SetMinRadius(const double min_radius)
+		{
+			MinRadius = min_radius;
+			return *this;
+		}
+
+		/// Cell size cached stencils are built for, pass grid.CellSize() for grids with Semantics::RuntimeCellSize.
+		/// Grids of another size run the query without the stencil.
+		Self& SetCellSize(const double cell_size) requires (HasRuntimeCellSize<Semantics>())
+		{
+			CellSize = cell_size;
+			return *this;
+		}
 		
 		template<EQueryCacheType CacheType>
 		TSphereQuery<Semantics, CacheType> Build()
@@ -204,25 +629,34 @@ namespace SpatialGrid
 			}
 			else
 			{
-				return TSphereQuery<Semantics, EQueryCacheType::UnCached>(Radius);
+				return TSphereQuery<Semantics, EQueryCacheType::UnCached>(Radius, MinRadius);
 			}
 		}
 		
 	private:
 		double Radius = Semantics::CellSize;
+		double MinRadius = 0.;
+		double CellSize = Semantics::CellSize;
 		
 		TSphereQuery<Semantics, EQueryCacheType::Cached> BuildCached()
 		{
-			TSphereQuery<Semantics, EQueryCacheType::Cached> query(Radius);
+			TSphereQuery<Semantics, EQueryCacheType::Cached> query(Radius, MinRadius);
+			query.CellSize = CellSize;
 			
-			const int32 bounds = FMath::RoundToInt32(Radius / Semantics::CellSize) + 1;
-			constexpr FVector cell_extent = SpatialGrid::CellExtent<Semantics>();
+			const int32 bounds = FMath::RoundToInt32(Radius / CellSize) + 1;
+			const FVector cell_extent = SpatialGrid::CellExtent<Semantics>(CellSize);
+			const double half_diagonal = SpatialGrid::HalfDiagonal<Semantics>(CellSize);
 			// Adjust radius to account for worst-case sphere center position
-			const double effective_radius_sq = FMath::Square(Radius - SpatialGrid::HalfDiagonal<Semantics>());
+			const double effective_radius_sq = FMath::Square(Radius - half_diagonal);
+			// No element stored in a cell closer than this can reach the annulus, from anywhere in the origin cell
+			const double hole_radius = MinRadius - Semantics::MaxElementRadius - half_diagonal;
+			const double hole_radius_sq = hole_radius > 0. ? hole_radius * hole_radius : 0.;
+			const double min_radius_sq = FMath::Square(MinRadius + half_diagonal);
 			
-			CellRange(bounds).ForEach([&](const CellIndex& index)
+			// Planar columns reach every height, they are never inside the sphere or its hole and always test elements.
+			NeighbourRange<Semantics>(bounds).ForEach([&](const CellIndex& index)
 			{
-				const FVector cell_center(index * Semantics::CellSize);
+				const FVector cell_center = FVector(index) * CellSize;
 		
 				// For each cell, select the corner coordinate that's furthest from origin
 				FVector farthest;
@@ -230,7 +664,18 @@ namespace SpatialGrid
 				farthest.Y = 0. < cell_center.Y ? cell_center.Y + cell_extent.Y : cell_center.Y - cell_extent.Y;
 				farthest.Z = 0. < cell_center.Z ? cell_center.Z + cell_extent.Z : cell_center.Z - cell_extent.Z;
 				
-				if (farthest.SizeSquared() <= effective_radius_sq)
+				// And the coordinate closest to origin, zero along axes the cell spans
+				FVector nearest;
+				nearest.X = FMath::Max(FMath::Abs(cell_center.X) - cell_extent.X, 0.);
+				nearest.Y = FMath::Max(FMath::Abs(cell_center.Y) - cell_extent.Y, 0.);
+				nearest.Z = FMath::Max(FMath::Abs(cell_center.Z) - cell_extent.Z, 0.);
+				
+				if (farthest.SizeSquared() < hole_radius_sq)
+				{
+					return;
+				}
+				
+				if (farthest.SizeSquared() <= effective_radius_sq && (MinRadius <= 0. || nearest.SizeSquared() >= min_radius_sq))
 				{
 					query.InnerCells.Add(index);
 				}
@@ -0,0 +1,94 @@
+﻿#pragma once
+
+#include <iterator>
+
+#include "Grid.h"
+
+namespace SpatialGrid
+{
+	/// Element yielded by the query views.
+	template<typename Element>
+	struct TElementEntry
+	{
+		ElementId Id;
+		const Element* Value = nullptr;
+	};
+
+	/// Element yielded by the line trace view, together with where the line enters it.
+	template<typename Element>
+	struct TTraceEntry
+	{
+		ElementId Id;
+		const Element* Value = nullptr;
+		FVector Location = FVector::ZeroVector;
+	};
+
+	template<typename Cell>
+	struct TCellEntry
+	{
+		CellIndex Coords;
+		const Cell* Value = nullptr;
+	};
+
+	/**
+	 * Input iterator over a view that keeps every bit of iteration state itself (Current, Advance, IsDone).
+	 * begin() can be called again on a partially consumed view to continue where the last loop stopped,
+	 * e.g. `for (const auto& entry : view | std::views::take(64))` once per tick slices the work across frames.
+	 */
+	template<typename View>
+	struct TCursorIterator
+	{
+		using value_type		= typename View::ValueType;
+		using difference_type	= std::ptrdiff_t;
+
+		TCursorIterator() = default;
+		explicit TCursorIterator(View* view) : Owner(view) {}
+
+		const value_type& operator*() const { return Owner->Current(); }
+		const value_type* operator->() const { return &Owner->Current(); }
+
+		TCursorIterator& operator++()
+		{
+			Owner->Advance();
+			return *this;
+		}
+
+		void operator++(int) { Owner->Advance(); }
+
+		friend bool operator==(const TCursorIterator& it, std::default_sentinel_t) { return it.Owner->IsDone(); }
+
+	private:
+		View* Owner = nullptr;
+	};
+
+	/// Lazy walk over every cell of a grid in storage order.
+	/// Views must be restarted once cells were added or cleared.
+	template<typename Semantics>
+	struct TGridCellView
+	{
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using ValueType	= TCellEntry<Cell>;
+
+		explicit TGridCellView(const Grid& grid) : GridPtr(&grid)
+		{
+			Advance();
+		}
+
+		TCursorIterator<TGridCellView> begin() { return TCursorIterator<TGridCellView>(this); }
+		std::default_sentinel_t end() const { return std::default_sentinel; }
+
+		const ValueType& Current() const { return Entry; }
+		bool IsDone() const { return Entry.Value == nullptr; }
+
+		void Advance()
+		{
+			Entry.Value = Cursor < GridPtr->NumCells() ? &GridPtr->GetCellAt(Cursor++, Entry.Coords) : nullptr;
+		}
+
+	private:
+		const Grid* GridPtr = nullptr;
+		int32 Cursor = 0;
+		ValueType Entry;
+	};
+}
@@ -0,0 +1,164 @@
+﻿#pragma once
+
+#include "Async/ParallelFor.h"
+#include "Grid.h"
+
+namespace SpatialGrid
+{
+	enum class ETileColoring : uint8
+	{
+		/// Two colours in a 3D checkerboard, halos only hold cells across tile faces.
+		Checkerboard,
+		/// Eight colours from the tile coordinate parities, halos hold every neighbouring cell.
+		Octant,
+	};
+
+	/**
+	 * Partition of the occupied cells into tiles of TileSize x TileSize x TileSize cells, with the occupied cells
+	 * within HaloSize of every tile listed as its halo. ParallelForEachTile runs the tiles one colour at a time,
+	 * tiles of a colour never touch each other's cells or halos, so a job may write the cells of its tile and read
+	 * its halo without locks. The partition is a snapshot, Build it again once cells were added or cleared.
+	 */
+	template<typename Semantics>
+	struct TTilePartition
+	{
+		using Grid = TSpatialGrid<Semantics>;
+
+		struct Tile
+		{
+			CellIndex Coords;
+			TArray<CellIndex> Cells;
+			TArray<CellIndex> Halo;
+		};
+
+		explicit TTilePartition(const int32 tile_size = 4, const int32 halo_size = 1, const ETileColoring coloring = ETileColoring::Octant)
+		: TileSize(FMath::Max(tile_size, 1))
+		, HaloSize(FMath::Clamp(halo_size, 0, TileSize))
+		, Coloring(coloring)
+		{
+			checkf(halo_size <= tile_size, TEXT("halo must not reach past the neighbouring tiles"));
+		}
+
+		/// This function is not thread safe!!!
+		void Build(const Grid& grid)
+		{
+			Tiles.Reset();
+			for (TArray<int32>& color : Colors)
+			{
+				color.Reset();
+			}
+
+			ankerl::unordered_dense::map<CellIndex, int32> tile_lookup;
+
+			grid.ForEachCell([&](const CellIndex& coords, const typename Grid::Cell& cell)
+			{
+				if (!cell.HasElements())
+				{
+					return;
+				}
+
+				const auto [it, is_new] = tile_lookup.try_emplace(ToTile(coords), Tiles.Num());
+				if (is_new)
+				{
+					Tiles.Add(Tile{ .Coords = it->first });
+				}
+
+				Tiles[it->second].Cells.Add(coords);
+			});
+
+			// A cell close to a tile border is in the halo of the tiles across that border.
+			for (const Tile& tile : Tiles)
+			{
+				for (const CellIndex& coords : tile.Cells)
+				{
+					const CellIndex local = coords - tile.Coords * TileSize;
+
+					NeighbourRange<Semantics>(1).ForEach([&](const CellIndex& dir)
+					{
+						const int32 axes = (dir.X != 0) + (dir.Y != 0) + (dir.Z != 0);
+						if (axes == 0 || (Coloring == ETileColoring::Checkerboard && axes > 1))
+						{
+							return;
+						}
+
+						for (int32 axis = 0; axis < 3; ++axis)
+						{
+							if ((dir[axis] < 0 && local[axis] >= HaloSize) || (dir[axis] > 0 && local[axis] < TileSize - HaloSize))
+							{
+								return;
+							}
+						}
+
+						if (const auto neighbour = tile_lookup.find(tile.Coords + dir); neighbour != tile_lookup.end())
+						{
+							Tiles[neighbour->second].Halo.Add(coords);
+						}
+					});
+				}
+			}
+
+			for (int32 index = 0; index < Tiles.Num(); ++index)
+			{
+				Colors[ColorOf(Tiles[index].Coords)].Add(index);
+			}
+		}
+
+		const TArray<Tile>& GetTiles() const
+		{
+			return Tiles;
+		}
+
+		int32 NumColors() const
+		{
+			return Coloring == ETileColoring::Checkerboard ? 2 : 8;
+		}
+
+		/// Indices of the tiles of `color` into GetTiles().
+		TConstArrayView<int32> GetColor(const int32 color) const
+		{
+			return Colors[color];
+		}
+
+		/// Runs func(tile) for every tile, one colour after another with the tiles of a colour in parallel.
+		template<typename F>
+		void ParallelForEachTile(F&& func) const
+		{
+			for (int32 color = 0; color < NumColors(); ++color)
+			{
+				const TArray<int32>& tiles = Colors[color];
+
+				ParallelFor(TEXT("SpatialGrid.ForEachTile"), tiles.Num(), 1, [&](const int32 index)
+				{
+					func(Tiles[tiles[index]]);
+				});
+			}
+		}
+
+	private:
+		int32 TileSize;
+		int32 HaloSize;
+		ETileColoring Coloring;
+		TArray<Tile> Tiles;
+		TArray<int32> Colors[8];
+
+		CellIndex ToTile(const CellIndex& coords) const
+		{
+			auto floor_div = [this](const int32 value)
+			{
+				return value >= 0 ? value / TileSize : (value - TileSize + 1) / TileSize;
+			};
+
+			return CellIndex(floor_div(coords.X), floor_div(coords.Y), floor_div(coords.Z));
+		}
+
+		int32 ColorOf(const CellIndex& tile) const
+		{
+			if (Coloring == ETileColoring::Checkerboard)
+			{
+				return (tile.X + tile.Y + tile.Z) & 1;
+			}
+
+			return (tile.X & 1) | ((tile.Y & 1) << 1) | ((tile.Z & 1) << 2);
+		}
+	};
+}
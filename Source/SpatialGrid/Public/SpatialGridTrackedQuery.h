@@ -0,0 +1,335 @@
+﻿#pragma once
+
+#include "Grid.h"
+#include "SpatialGridUtils.h"
+
+namespace SpatialGrid
+{
+	enum class ETrackedQueryEvent : uint8
+	{
+		Entered,
+		Exited,
+		Stayed,
+	};
+
+	/**
+	 * Sphere query that keeps its result set between updates and only reports what changed.
+	 * When the observer moves, only cells whose inner/edge/outer classification changed are rescanned,
+	 * element moves are reconciled through the grid change feed (requires Semantics::TrackChanges). Only changes
+ * landing within reach of the query or touching its result set look up the element, except on grids with
+ * oversized elements, whose reach the recorded cell doesn't bound.
+	 * The query never trims the feed itself, other consumers may still need older changes. Trim it to the smallest
+	 * GetChangeCursor of all consumers after they updated, otherwise it grows up to ChangeFeedCapacity.
+	 */
+	template<typename Semantics>
+	struct TTrackedSphereQuery
+	{
+		static_assert(TracksChanges<Semantics>(), "tracked queries require Semantics::TrackChanges");
+
+		using Grid		= TSpatialGrid<Semantics>;
+		using Cell		= typename Grid::Cell;
+		using Element	= typename Grid::Element;
+
+		explicit TTrackedSphereQuery(const double radius) : Radius(radius) {}
+
+		/// This function is not thread safe!!!
+		/// Moves the query to `origin` and calls func(id, event) for every element that entered or exited.
+		template<typename F>
+		void Update(const Grid& grid, const FVector& origin, F&& func)
+		{
+			++Generation;
+
+			if (!bHasOrigin || !grid.CanReplayChangesSince(ChangeCursor))
+			{
+				Rescan(grid, origin, func);
+			}
+			else
+			{
+				const Reach reach = MakeReach(grid, origin);
+
+				grid.ForEachChangeSince(ChangeCursor, [&](const ElementChange& change)
+				{
+					// Changes of elements that weren't inside and ended up out of reach can't produce an event,
+					// they are dropped before paying for the element lookup.
+					const bool in_reach = change.Type != EElementChange::Removed && reach.Contains(change.Cell);
+					if (!in_reach && !HasOversizedElements<Semantics>() && !Inside.contains(change.Id))
+					{
+						return;
+					}
+
+					const Element* element = change.Type != EElementChange::Removed ? grid.GetElement(change.Id) : nullptr;
+					Apply(change.Id, element && element->Bounds.OverlapsSphere(origin, Radius), func);
+				});
+
+				if (origin != Origin)
+				{
+					ScanDelta(grid, origin, func);
+				}
+			}
+
+			Origin = origin;
+			bHasOrigin = true;
+			ChangeCursor = grid.ChangeSequence();
+		}
+
+		/// Reports every element that was inside before the last update and still is.
+		template<typename F>
+		void ForEachStayed(F&& func) const
+		{
+			for (const auto& [id, entered] : Inside)
+			{
+				if (entered != Generation)
+				{
+					func(id, ETrackedQueryEvent::Stayed);
+				}
+			}
+		}
+
+		template<typename F>
+		void Each(F&& func) const
+		{
+			for (const auto& [id, _] : Inside)
+			{
+				func(id);
+			}
+		}
+
+		bool Contains(const ElementId& id) const { return Inside.contains(id); }
+
+		/// Grid change sequence the next update replays from, changes before it can be trimmed, see TSpatialGrid::TrimChanges.
+		uint64 GetChangeCursor() const { return ChangeCursor; }
+
+		int32 Num() const { return Inside.size(); }
+
+		/// Forgets the result set, the next update rescans the whole stencil without reporting exits.
+		void Reset()
+		{
+			Inside.clear();
+			bHasOrigin = false;
+		}
+
+	private:
+		/// Inclusive range of cells along one row.
+		struct Span
+		{
+			int32 Min = 0;
+			int32 Max = -1;
+
+			bool Contains(const int32 x) const { return x >= Min && x <= Max; }
+		};
+
+		double Radius = 0;
+		FVector Origin = FVector::ZeroVector;
+		bool bHasOrigin = false;
+		uint32 Generation = 0;
+		uint64 ChangeCursor = 0;
+		/// Element -> generation it entered at.
+		ankerl::unordered_dense::map<ElementId, uint32> Inside;
+
+		template<typename F>
+		void Apply(const ElementId id, const bool inside, F& func)
+		{
+			if (inside)
+			{
+				if (Inside.try_emplace(id, Generation).second)
+				{
+					func(id, ETrackedQueryEvent::Entered);
+				}
+			}
+			else if (Inside.erase(id) > 0)
+			{
+				func(id, ETrackedQueryEvent::Exited);
+			}
+		}
+
+		/// Cells around an origin that can hold elements overlapping the sphere, oversized elements excepted.
+		struct Reach
+		{
+			FVector Center;
+			double Radius;
+			Span Y;
+			Span Z;
+
+			bool Contains(const CellIndex& cell) const
+			{
+				return Z.Contains(cell.Z) && Y.Contains(cell.Y)
+					&& ReachSpan(Center.X, Radius, NearSq(cell.Y, Center.Y) + NearSq(cell.Z, Center.Z)).Contains(cell.X);
+			}
+		};
+
+		Reach MakeReach(const Grid& grid, const FVector& origin) const
+		{
+			const double reach = ReachRadius(grid.CellSize());
+			const FVector center = grid.LocationToCellSpace(origin);
+			return Reach{ .Center = center, .Radius = reach, .Y = AxisSpan(center.Y, reach), .Z = LayerSpan(center.Z, reach) };
+		}
+
+		/// Radius in cell units an element center can be at and still overlap the sphere.
+		double ReachRadius(const double cell_size) const
+		{
+			return (Radius + Semantics::MaxElementRadius) / cell_size;
+		}
+
+		/// Cells along the row that can hold overlapping elements, `near_sq` is the squared distance to the row.
+		static Span ReachSpan(const double center, const double reach, const double near_sq)
+		{
+			const double rem = FMath::Square(reach) - near_sq;
+			if (rem < 0.)
+			{
+				return Span();
+			}
+
+			const double half_width = FMath::Sqrt(rem) + 0.5;
+			return Span{ FMath::CeilToInt32(center - half_width), FMath::FloorToInt32(center + half_width) };
+		}
+
+		/// Cells along the row that lie completely inside the sphere, `far_sq` is the squared distance to the far row edge.
+		/// Planar columns span every height and are never completely inside.
+		static Span InnerSpan(const double center, const double radius, const double far_sq)
+		{
+			const double rem = FMath::Square(radius) - far_sq;
+			if (IsPlanar<Semantics>() || rem < 0.25)
+			{
+				return Span();
+			}
+
+			const double half_width = FMath::Sqrt(rem) - 0.5;
+			return Span{ FMath::CeilToInt32(center - half_width), FMath::FloorToInt32(center + half_width) };
+		}
+
+		static Span AxisSpan(const double center, const double reach)
+		{
+			return Span{ FMath::CeilToInt32(center - reach - 0.5), FMath::FloorToInt32(center + reach + 0.5) };
+		}
+
+		/// Layers along Z the sphere can reach, planar grids only have layer 0.
+		static Span LayerSpan(const double center, const double reach)
+		{
+			if constexpr (IsPlanar<Semantics>())
+			{
+				return Span{ 0, 0 };
+			}
+			else
+			{
+				return AxisSpan(center, reach);
+			}
+		}
+
+		static double NearSq(const int32 index, const double center)
+		{
+			return FMath::Square(FMath::Max(FMath::Abs(index - center) - 0.5, 0.));
+		}
+
+		static double FarSq(const int32 index, const double center)
+		{
+			return FMath::Square(FMath::Abs(index - center) + 0.5);
+		}
+
+		/// Rescans only the cells whose classification changed between the previous and the new origin,
+		/// cells completely inside both spheres and cells unreachable from both are skipped.
+		template<typename F>
+		void ScanDelta(const Grid& grid, const FVector& origin, F& func)
+		{
+			const double cell_size = grid.CellSize();
+			const double reach = ReachRadius(cell_size);
+			const double radius = Radius / cell_size;
+			const FVector prev = grid.LocationToCellSpace(Origin);
+			const FVector next = grid.LocationToCellSpace(origin);
+			TOversizedVisits<Semantics> visits;
+
+			const Span prev_z = LayerSpan(prev.Z, reach), next_z = LayerSpan(next.Z, reach);
+			const Span prev_y = AxisSpan(prev.Y, reach), next_y = AxisSpan(next.Y, reach);
+
+			for (int32 z = FMath::Min(prev_z.Min, next_z.Min); z <= FMath::Max(prev_z.Max, next_z.Max); ++z)
+			{
+				for (int32 y = FMath::Min(prev_y.Min, next_y.Min); y <= FMath::Max(prev_y.Max, next_y.Max); ++y)
+				{
+					const Span prev_reach = ReachSpan(prev.X, reach, NearSq(y, prev.Y) + NearSq(z, prev.Z));
+					const Span next_reach = ReachSpan(next.X, reach, NearSq(y, next.Y) + NearSq(z, next.Z));
+					const Span prev_inner = InnerSpan(prev.X, radius, FarSq(y, prev.Y) + FarSq(z, prev.Z));
+					const Span next_inner = InnerSpan(next.X, radius, FarSq(y, next.Y) + FarSq(z, next.Z));
+
+					const int32 min_x = FMath::Min(prev_reach.Min, next_reach.Min);
+					const int32 max_x = FMath::Max(prev_reach.Max, next_reach.Max);
+
+					for (int32 x = min_x; x <= max_x; ++x)
+					{
+						if (prev_inner.Contains(x) && next_inner.Contains(x))
+						{
+							// Elements of this cell were and still are inside, jump over the shared interior.
+							x = FMath::Min(prev_inner.Max, next_inner.Max);
+							continue;
+						}
+
+						const bool prev_reachable = prev_reach.Contains(x);
+						const bool next_reachable = next_reach.Contains(x);
+						if (!prev_reachable && !next_reachable)
+						{
+							continue;
+						}
+
+						grid.GetCell(CellIndex(x, y, z), [&](const Cell& cell)
+						{
+							cell.ForEachRegularElement(grid, [&](const ElementId id, const Element& element)
+							{
+								Apply(id, next_reachable && element.Bounds.OverlapsSphere(origin, Radius), func);
+							});
+
+							// Oversized elements reach further than the cell reach spans, they always get the full test.
+							cell.ForEachOversized(grid, visits, [&](const ElementId id, const Element& element)
+							{
+								Apply(id, element.Bounds.OverlapsSphere(origin, Radius), func);
+							});
+						});
+					}
+				}
+			}
+		}
+
+		/// Full stencil scan against `origin`, reports the difference to the current result set.
+		template<typename F>
+		void Rescan(const Grid& grid, const FVector& origin, F& func)
+		{
+			const double reach = ReachRadius(grid.CellSize());
+			const FVector center = grid.LocationToCellSpace(origin);
+			const Span span_z = LayerSpan(center.Z, reach);
+			const Span span_y = AxisSpan(center.Y, reach);
+
+			ankerl::unordered_dense::set<ElementId> found;
+			TOversizedVisits<Semantics> visits;
+
+			for (int32 z = span_z.Min; z <= span_z.Max; ++z)
+			{
+				for (int32 y = span_y.Min; y <= span_y.Max; ++y)
+				{
+					const Span row = ReachSpan(center.X, reach, NearSq(y, center.Y) + NearSq(z, center.Z));
+
+					for (int32 x = row.Min; x <= row.Max; ++x)
+					{
+						grid.GetCell(CellIndex(x, y, z), [&](const Cell& cell)
+						{
+							cell.ForEachElement(grid, visits, [&](const ElementId id, const Element& element)
+							{
+								if (element.Bounds.OverlapsSphere(origin, Radius))
+								{
+									found.insert(id);
+									Apply(id, true, func);
+								}
+							});
+						});
+					}
+				}
+			}
+
+			std::erase_if(Inside, [&](const auto& entry)
+			{
+				if (const ElementId id = entry.first; !found.contains(id))
+				{
+					func(id, ETrackedQueryEvent::Exited);
+					return true;
+				}
+				return false;
+			});
+		}
+	};
+}
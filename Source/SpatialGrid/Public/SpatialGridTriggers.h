@@ -0,0 +1,78 @@
+﻿#pragma once
+
+#include "SlotMap.h"
+#include "SpatialGridTypes.h"
+#include "unordered_dense.h"
+
+namespace SpatialGrid
+{
+	using TriggerId = ElementId;
+
+	enum class ETriggerEvent : uint8
+	{
+		Enter,
+		Exit,
+	};
+
+	struct TriggerEvent
+	{
+		TriggerId Trigger;
+		ElementId Element;
+		ETriggerEvent Type;
+	};
+
+	/**
+	 * Standing query volumes indexed by the cells they can be overlapped from.
+	 * The grid notifies the registry on every element add, move and removal, only the volumes attached to the
+	 * old and new cell are evaluated and enter/exit transitions are appended to a batch buffer.
+	 */
+	struct SPATIALGRID_API TriggerRegistry
+	{
+		/// `cells` must contain every cell an element overlapping `bounds` can be stored in.
+		TriggerId Add(const Bounds& bounds, TArray<CellIndex>&& cells);
+
+		/// Emits an exit event for every element still inside the volume.
+		bool Remove(const TriggerId id);
+
+		const Bounds* Get(const TriggerId id) const;
+
+		const TArray<CellIndex>* GetCells(const TriggerId id) const;
+
+		int32 Num() const { return Volumes.Num(); }
+
+		bool IsEmpty() const { return CellTriggers.empty(); }
+
+		/// Replaces the cells of every volume after the grid changed its cell layout, `cells_of` lists them for the
+		/// bounds of a volume like the cells passed to Add.
+		void Reindex(TFunctionRef<TArray<CellIndex>(const Bounds&)> cells_of);
+
+		/// Moves every volume by `delta`, cells are left alone and have to be reindexed unless they still line up.
+		void ShiftBy(const FVector& delta);
+
+		/// Tests a single element against a single volume, used to seed a freshly added volume.
+		void Evaluate(const TriggerId trigger, const ElementId id, const Bounds& bounds);
+
+		void OnElementAdded(const ElementId id, const Bounds& bounds, const CellIndex& cell);
+		void OnElementMoved(const ElementId id, const Bounds& bounds, const CellIndex& prev_cell, const CellIndex& cell);
+		void OnElementRemoved(const ElementId id, const CellIndex& cell);
+
+		TConstArrayView<TriggerEvent> GetEvents() const { return Events; }
+
+		void ResetEvents() { Events.Reset(); }
+
+	private:
+		struct Volume
+		{
+			Bounds Bounds;
+			TArray<CellIndex> Cells;
+			ankerl::unordered_dense::set<ElementId> Inside;
+		};
+
+		TSlotMap<Volume> Volumes;
+		ankerl::unordered_dense::map<CellIndex, TArray<TriggerId>> CellTriggers;
+		TArray<TriggerEvent> Events;
+
+		void Test(const TriggerId trigger, Volume& volume, const ElementId id, const Bounds& bounds);
+		void TestCell(const CellIndex& cell, const ElementId id, const Bounds& bounds);
+	};
+}
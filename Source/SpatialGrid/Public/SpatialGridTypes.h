@@ -19,6 +19,22 @@ namespace SpatialGrid
 		uint32_t Version;
 	};
 
+	enum class EElementChange : uint8
+	{
+		Added,
+		Moved,
+		Removed,
+	};
+
+	/// Entry of the grid change feed, see TSpatialGrid::ForEachChangeSince.
+	struct ElementChange
+	{
+		ElementId Id;
+		EElementChange Type;
+		CellIndex PrevCell;
+		CellIndex Cell;
+	};
+
 	enum class BoundsType : uint8
 	{
 		Box,
@@ -41,9 +57,13 @@ namespace SpatialGrid
 		}
 
 		FBox GetBox() const;
+		FBox GetBoundingBox() const;
 		double GetRadius() const;
 		bool OverlapsSphere(const FVector& sphere_origin, const double sphere_radius) const;
+		bool InsideSphere(const FVector& sphere_origin, const double sphere_radius) const;
 		bool OverlapsBox(const FVector& box_origin, const FVector& box_extent) const;
+		bool Overlaps(const Bounds& other) const;
+		bool OverlapsCapsule(const FVector& start, const FVector& end, const double radius) const;
 		bool LineHitPoint(const FVector& start, const FVector& end, const FVector& dir, const FVector& inv_dir,
 			FVector& out_hit) const;
 
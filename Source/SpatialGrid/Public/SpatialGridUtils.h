@@ -13,6 +13,17 @@ namespace SpatialGrid
 		{
 			return ((Step.X * 2) + 1) * ((Step.Y * 2) + 1) * ((Step.Z * 2) + 1);
 		}
+
+		/// Coordinates of the `index`-th cell in ForEach order.
+		FORCEINLINE CellIndex Get(const int32 index, const CellIndex& offset) const
+		{
+			const int32 size_x = (Step.X * 2) + 1;
+			const int32 size_y = (Step.Y * 2) + 1;
+			return CellIndex(
+				index % size_x - Step.X + offset.X,
+				(index / size_x) % size_y - Step.Y + offset.Y,
+				index / (size_x * size_y) - Step.Z + offset.Z);
+		}
 		
 		template<typename IterFunc>
 		void ForEach(IterFunc&& func) const
@@ -57,16 +68,216 @@ namespace SpatialGrid
 		return GridSemantics::CellSize * 0.5;
 	}
 
+	/// Grids bucket elements by X and Y only when Semantics::Dimensions is 2. Their cells are columns spanning every
+	/// height with Z coordinate 0, element tests still use the full 3D bounds.
+	template<typename GridSemantics>
+	static consteval int32 GridDimensions()
+	{
+		if constexpr (requires { GridSemantics::Dimensions; })
+		{
+			return GridSemantics::Dimensions;
+		}
+		else
+		{
+			return 3;
+		}
+	}
+
+	template<typename GridSemantics>
+	static consteval bool IsPlanar()
+	{
+		return GridDimensions<GridSemantics>() == 2;
+	}
+
+	/// Cells within `step` of a cell on every axis the grid buckets by.
+	template<typename GridSemantics>
+	static CellRange NeighbourRange(const int32 step)
+	{
+		return CellRange(CellIndex(step, step, IsPlanar<GridSemantics>() ? 0 : step));
+	}
+
+	/// Grids take their cell size at construction when Semantics::RuntimeCellSize is true, Semantics::CellSize is
+	/// then only the default. See TSpatialGrid::Rebuild.
+	template<typename GridSemantics>
+	static consteval bool HasRuntimeCellSize()
+	{
+		if constexpr (requires { GridSemantics::RuntimeCellSize; })
+		{
+			return GridSemantics::RuntimeCellSize;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	/// Cell size of compile time grids, folds to Semantics::CellSize.
+	template<typename GridSemantics>
+	struct TCellSize
+	{
+		static constexpr double Get() { return GridSemantics::CellSize; }
+		static constexpr double GetInverse() { return 1. / GridSemantics::CellSize; }
+	};
+
+	/// Cell size of runtime grids, the reciprocal is kept so locations map to cells without a division.
+	template<typename GridSemantics> requires (HasRuntimeCellSize<GridSemantics>())
+	struct TCellSize<GridSemantics>
+	{
+		double Get() const { return Size; }
+		double GetInverse() const { return Inverse; }
+
+		void Set(const double size)
+		{
+			Size = size;
+			Inverse = 1. / size;
+		}
+
+	private:
+		double Size = GridSemantics::CellSize;
+		double Inverse = 1. / GridSemantics::CellSize;
+	};
+
+	/// Grids record a change feed of element adds, moves and removals when Semantics::TrackChanges is true.
+	template<typename GridSemantics>
+	static consteval bool TracksChanges()
+	{
+		if constexpr (requires { GridSemantics::TrackChanges; })
+		{
+			return GridSemantics::TrackChanges;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	/// Changes the feed holds at most, Semantics::MaxTrackedChanges or 1M by default. A full feed drops its older
+	/// half, consumers that fell that far behind resync from scratch. Keep it above the changes of a frame.
+	template<typename GridSemantics>
+	static consteval int32 ChangeFeedCapacity()
+	{
+		if constexpr (requires { GridSemantics::MaxTrackedChanges; })
+		{
+			return GridSemantics::MaxTrackedChanges;
+		}
+		else
+		{
+			return 1 << 20;
+		}
+	}
+
+	/// Grids support lock free element reads under an epoch guard when Semantics::EpochReads is true.
+	template<typename GridSemantics>
+	static consteval bool UsesEpochReads()
+	{
+		if constexpr (requires { GridSemantics::EpochReads; })
+		{
+			return GridSemantics::EpochReads;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	/// Grids take elements larger than Semantics::MaxElementRadius when Semantics::OversizedElements is true, those are
+	/// registered in every cell they overlap. Meant for a handful of huge elements, see TSpatialGrid::AddElement.
+	template<typename GridSemantics>
+	static consteval bool HasOversizedElements()
+	{
+		if constexpr (requires { GridSemantics::OversizedElements; })
+		{
+			return GridSemantics::OversizedElements;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	/// Placeholder for the oversized element bookkeeping of grids without Semantics::OversizedElements.
+	struct NoOversizedElements {};
+
+	/// Oversized elements a query already handed out, grids without Semantics::OversizedElements never have any.
+	template<typename GridSemantics>
+	struct TOversizedVisits
+	{
+		bool Visit(const int32) { return true; }
+	};
+
+	/**
+	 * Stamp of the oversized elements a query already handed out, one bit per oversized slot of the grid.
+	 * Every query call keeps its own on the stack, so concurrent queries never share stamps, and it stays empty
+	 * until the query meets an oversized element.
+	 */
+	template<typename GridSemantics> requires (HasOversizedElements<GridSemantics>())
+	struct TOversizedVisits<GridSemantics>
+	{
+		/// True the first time `slot` is visited.
+		bool Visit(const int32 slot)
+		{
+			const int32 word = slot / 64;
+			if (word >= Words.Num())
+			{
+				Words.SetNumZeroed(word + 1);
+			}
+
+			const uint64 bit = uint64(1) << (slot % 64);
+			const bool first = (Words[word] & bit) == 0;
+			Words[word] |= bit;
+			return first;
+		}
+
+	private:
+		TArray<uint64, TInlineAllocator<2>> Words;
+	};
+
+	/// Placeholder for semantics without Semantics::ColdData.
+	struct NoColdData {};
+
+	/// Part of the element payload queries never read, stored apart from the hot Element entries.
+	template<typename GridSemantics>
+	struct TColdData
+	{
+		using Type = NoColdData;
+	};
+
+	template<typename GridSemantics> requires requires { typename GridSemantics::ColdData; }
+	struct TColdData<GridSemantics>
+	{
+		using Type = typename GridSemantics::ColdData;
+	};
+
+	template<typename GridSemantics>
+	static consteval bool HasColdData()
+	{
+		return !std::is_same_v<typename TColdData<GridSemantics>::Type, NoColdData>;
+	}
+
+	/// Entries handed to a worker at once by the parallel loops, at least 64 and a multiple of the entries
+	/// fitting a cache line, so neighbouring chunks rarely share a line and tasks stay cheap relative to their work.
+	template<typename Entry>
+	static consteval int32 ParallelChunkSize()
+	{
+		constexpr int32 per_line = FMath::Max<int32>(PLATFORM_CACHE_LINE_SIZE / sizeof(Entry), 1);
+		return FMath::DivideAndRoundUp<int32>(64, per_line) * per_line;
+	}
+
 	template<typename GridSemantics>
-	static constexpr double HalfDiagonal()
+	static double HalfDiagonal(const double cell_size)
 	{
-		return HalfCellSize<GridSemantics>() * FMath::Sqrt(3.0);
+		return cell_size * 0.5 * FMath::Sqrt(double(GridDimensions<GridSemantics>()));
 	}
 
 	template<typename GridSemantics>
-	static consteval FVector CellExtent()
+	static FVector CellExtent(const double cell_size)
 	{
-		return FVector(HalfCellSize<GridSemantics>(), UE::Math::TVectorConstInit());
+		FVector extent(cell_size * 0.5);
+		if constexpr (IsPlanar<GridSemantics>())
+		{
+			extent.Z = UE_LARGE_WORLD_MAX;
+		}
+		return extent;
 	}
 	
 	FORCEINLINE static CellIndex RoundVecToInt(const FVector& vector)
@@ -77,6 +288,25 @@ namespace SpatialGrid
 		FMath::RoundToInt32(vector.Z));
 	}
 
+	/// Interleaved bits of the cell coordinates, cells close in Morton order are close in space.
+	/// Coordinates wrap around beyond +-2^20 cells.
+	FORCEINLINE static uint64 MortonCode(const CellIndex& coords)
+	{
+		auto spread = [](uint64 v)
+		{
+			v &= 0x1fffff;
+			v = (v | v << 32) & 0x1f00000000ffffull;
+			v = (v | v << 16) & 0x1f0000ff0000ffull;
+			v = (v | v << 8) & 0x100f00f00f00f00full;
+			v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+			v = (v | v << 2) & 0x1249249249249249ull;
+			return v;
+		};
+
+		constexpr uint32 bias = 1u << 20;
+		return spread(uint32(coords.X) + bias) | spread(uint32(coords.Y) + bias) << 1 | spread(uint32(coords.Z) + bias) << 2;
+	}
+
 	FORCEINLINE static bool BoxIntersectsSphere(const FBox& Box, const FVector& SphereOrigin, const double SphereRadius)
 	{
 		return FVector::DistSquared(SphereOrigin, Box.GetClosestPointTo(SphereOrigin)) <= FMath::Square(SphereRadius);
@@ -88,6 +318,12 @@ namespace SpatialGrid
 		return BoxIntersectsSphere(FBox(BoxOrigin - BoxExtent, BoxOrigin + BoxExtent), SphereOrigin, SphereRadius);
 	}
 
+	/// Squared distance from `point` to the corner of `box` furthest away from it.
+	FORCEINLINE static double BoxFarthestDistanceSquared(const FBox& box, const FVector& point)
+	{
+		return FVector::Max((box.Min - point).GetAbs(), (box.Max - point).GetAbs()).SizeSquared();
+	}
+
 	FORCEINLINE static bool BoxIntersectsSphereRadiusSq(const FBox& Box, const FVector& SphereOrigin, const double RadiusSq)
 	{
 		return FVector::DistSquared(SphereOrigin, Box.GetClosestPointTo(SphereOrigin)) <= RadiusSq;
@@ -139,6 +375,65 @@ namespace SpatialGrid
 		return true;
 	}
 	
+	/// Squared distance between a segment and a box, zero if they intersect.
+	static double SegmentBoxDistanceSquared(const FVector& start, const FVector& end, const FBox& box)
+	{
+		const FVector dir = end - start;
+
+		// The squared distance is quadratic between the points where the segment crosses a slab boundary.
+		double breaks[8] = { 0., 1. };
+		int32 count = 2;
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (dir[axis] == 0.)
+			{
+				continue;
+			}
+
+			for (const double bound : { box.Min[axis], box.Max[axis] })
+			{
+				if (const double t = (bound - start[axis]) / dir[axis]; t > 0. && t < 1.)
+				{
+					breaks[count++] = t;
+				}
+			}
+		}
+
+		std::sort(breaks, breaks + count);
+
+		double best = TNumericLimits<double>::Max();
+
+		for (int32 i = 0; i + 1 < count; ++i)
+		{
+			const double t0 = breaks[i];
+			const double t1 = breaks[i + 1];
+			const double mid = (t0 + t1) * 0.5;
+
+			// a * t^2 + b * t + c over the axes the segment is outside of on this piece
+			double a = 0., b = 0., c = 0.;
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const double p = start[axis] + dir[axis] * mid;
+				const double bound = p < box.Min[axis] ? box.Min[axis] : (p > box.Max[axis] ? box.Max[axis] : p);
+
+				if (bound != p)
+				{
+					const double offset = start[axis] - bound;
+					a += dir[axis] * dir[axis];
+					b += 2. * offset * dir[axis];
+					c += offset * offset;
+				}
+			}
+
+			const double t = a > 0. ? FMath::Clamp(-b / (2. * a), t0, t1) : t0;
+			best = FMath::Min(best, (a * t + b) * t + c);
+		}
+
+		return FMath::Max(best, 0.);
+	}
+
 	static bool LineIntersectsBox(const FBox& box, const FVector& start, const FVector& inv_dir)
 	{
 		double t_entry = TNumericLimits<double>::Lowest();